@@ -0,0 +1,433 @@
+#include "Benchmark.h"
+#include "ERenderer.h"
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+
+	using namespace Elite;
+	using Clock = std::chrono::steady_clock;
+
+	volatile size_t g_Sink{}; // kernel results end up here so the work cannot be optimised away
+
+	// mt19937 is specified bit for bit, the standard distributions are not.
+	// Mapping its output to floats by hand keeps the sets identical across compilers and releases.
+	class Random final
+	{
+	public:
+
+		explicit Random(uint32_t seed)
+			: m_Engine{ seed }
+		{}
+
+		float Next(float low, float high)
+		{
+			return low + (high - low) * static_cast<float>(m_Engine() >> 8) * (1.f / 16777216.f);
+		}
+
+		WorldPoint NextPoint(WorldPoint const& low, WorldPoint const& high)
+		{
+			return { Next(low.x, high.x), Next(low.y, high.y), Next(low.z, high.z) };
+		}
+
+		// Uniform over the unit sphere: rejection sampling the unit ball
+		WorldVector NextDirection()
+		{
+			for (;;)
+			{
+				const WorldVector direction{ Next(-1.f, 1.f), Next(-1.f, 1.f), Next(-1.f, 1.f) };
+				const WorldValue squareLength{ SqrMagnitude(direction) };
+				if (squareLength > 1e-4f && squareLength <= 1.f)
+					return direction / sqrt(squareLength);
+			}
+		}
+
+	private:
+
+		std::mt19937 m_Engine;
+
+	};
+
+	// Primitives are spread over a volume in front of the camera, every ray set points into it
+	const WorldPoint VOLUME_LOW{ -4.f, -4.f, 2.f };
+	const WorldPoint VOLUME_HIGH{ 4.f, 4.f, 10.f };
+
+	struct Primitives
+	{
+		std::vector<Plane> planes;
+		std::vector<Sphere> spheres;
+		std::vector<Mesh::Record> triangles;
+		SphereSet sphereSet; // the same spheres
+	};
+
+	Primitives MakePrimitives(Random& random, size_t count)
+	{
+		Primitives primitives{};
+		for (size_t i{}; i < count; ++i)
+		{
+			primitives.planes.push_back(Plane{ random.NextPoint(VOLUME_LOW, VOLUME_HIGH), random.NextDirection() });
+			primitives.spheres.push_back(Sphere{ random.NextPoint(VOLUME_LOW, VOLUME_HIGH), random.Next(.2f, .8f) });
+
+			const WorldPoint a{ random.NextPoint(VOLUME_LOW, VOLUME_HIGH) };
+			const WorldVector edge1{ random.NextDirection() * random.Next(.5f, 2.f) };
+			const WorldVector edge2{ random.NextDirection() * random.Next(.5f, 2.f) };
+			primitives.triangles.push_back(Mesh::Record{ a, edge1, edge2, Cross(edge1, edge2) });
+		}
+		primitives.sphereSet.SetSpheres(primitives.spheres);
+		return primitives;
+	}
+
+	struct RaySet
+	{
+		char const* name;
+		std::vector<Ray> rays;
+		WorldValue tMax;
+	};
+
+	Camera MakeCamera(RasterValue width, RasterValue height)
+	{
+		Camera camera{};
+		camera.SetScreenAspectRatio(static_cast<float>(width), static_cast<float>(height));
+		camera.SetPosition(WorldPoint{ 0.f, 0.f, 0.f });
+		camera.SetDirection(WorldVector{ 0.f, 0.f, 1.f });
+		camera.SetFieldOfView(float(E_PI_DIV_2));
+		return camera;
+	}
+
+	// Frame width and height holding about count pixels, the width a multiple of every packet width
+	RasterPoint FrameSize(size_t count)
+	{
+		const RasterValue width{ std::max<RasterValue>(16, (static_cast<RasterValue>(std::sqrt(double(count))) + 15) / 16 * 16) };
+		return { width, std::max<RasterValue>(1, count / width) };
+	}
+
+	// Camera rays in row major pixel order: neighbouring rays are neighbouring pixels
+	RaySet MakeCoherent(size_t count)
+	{
+		const RasterPoint size{ FrameSize(count) };
+		const Renderer::FrameSetup frame{ Renderer::SetupFrame(MakeCamera(size.x, size.y), size.x, size.y) };
+
+		RaySet set{ "coherent", {}, Ray::tMax };
+		set.rays.reserve(size.x * size.y);
+		for (RasterValue y{}; y < size.y; ++y)
+			for (RasterValue x{}; x < size.x; ++x)
+				set.rays.emplace_back(frame.origin, frame.direction + frame.xIncrement * static_cast<WorldValue>(x) + frame.yIncrement * static_cast<WorldValue>(y));
+		return set;
+	}
+
+	// Random origins around the volume, random directions
+	RaySet MakeIncoherent(Random& random, size_t count)
+	{
+		RaySet set{ "incoherent", {}, Ray::tMax };
+		set.rays.reserve(count);
+		for (size_t i{}; i < count; ++i)
+			set.rays.emplace_back(random.NextPoint(VOLUME_LOW - WorldVector{ 2.f, 2.f, 2.f }, VOLUME_HIGH + WorldVector{ 2.f, 2.f, 2.f }), random.NextDirection());
+		return set;
+	}
+
+	// Point light shadow rays as the renderer casts them: from the light to points in the volume, within [tMin, 1 - tMin]
+	RaySet MakeShadow(Random& random, size_t count)
+	{
+		const WorldPoint light{ 0.f, 8.f, 6.f };
+
+		RaySet set{ "shadow", {}, 1.f - Ray::tMin };
+		set.rays.reserve(count);
+		for (size_t i{}; i < count; ++i)
+			set.rays.emplace_back(light, random.NextPoint(VOLUME_LOW, VOLUME_HIGH) - light);
+		return set;
+	}
+
+	template<int W>
+	std::vector<RayPacket<W>> MakePackets(RaySet const& set)
+	{
+		std::vector<RayPacket<W>> packets{};
+		packets.reserve(set.rays.size() / W);
+		for (size_t first{}; first + W <= set.rays.size(); first += W)
+		{
+			WorldPoint origins[W]{};
+			WorldVector directions[W]{};
+			for (int lane{}; lane < W; ++lane)
+			{
+				origins[lane] = set.rays[first + lane].origin;
+				directions[lane] = set.rays[first + lane].direction;
+			}
+			packets.push_back(RayPacket<W>{ origins, directions, Ray::tMin, set.tMax, JL::simd::Mask<W>::All() });
+		}
+		return packets;
+	}
+
+	//
+	// Kernels, each returns a count that depends on all of its work
+	//
+
+	template<typename Object>
+	size_t IntersectScalar(RaySet const& set, std::vector<Object> const& objects)
+	{
+		size_t hits{};
+		for (Ray const& ray : set.rays)
+		{
+			for (Object const& object : objects)
+			{
+				Intersection t{};
+				if (JL::Intersect<CullMode::front, DIMENTIONS, WorldValue, void>(t, ray, object) && t >= Ray::tMin && t < set.tMax)
+					++hits;
+			}
+		}
+		return hits;
+	}
+
+	// Every ray against every cluster of the set, SphereSet::WIDTH spheres per test
+	size_t IntersectClusters(RaySet const& set, SphereSet const& spheres)
+	{
+		size_t hits{};
+		const auto clusters{ static_cast<SphereSet::Index>(spheres.GetClusters().size()) };
+		for (Ray const& ray : set.rays)
+		{
+			for (SphereSet::Index cluster{}; cluster < clusters; ++cluster)
+			{
+				Intersection t{};
+				if (JL::Intersect<CullMode::front, DIMENTIONS>(t, ray, spheres, cluster, Ray::tMin, set.tMax))
+					++hits;
+			}
+		}
+		return hits;
+	}
+
+	template<int W, typename Object>
+	size_t IntersectPacket(std::vector<RayPacket<W>> const& packets, std::vector<Object> const& objects)
+	{
+		using Lanes = JL::simd::Lanes<W>;
+		using Mask = JL::simd::Mask<W>;
+
+		size_t hits{};
+		for (RayPacket<W> const& packet : packets)
+		{
+			for (Object const& object : objects)
+			{
+				Lanes t{}, u{}, v{};
+				Mask valid{};
+				if constexpr (std::is_same_v<Object, Mesh::Record>)
+					valid = JL::Intersect<CullMode::front, DIMENTIONS, W>(t, u, v, packet, object);
+				else
+					valid = JL::Intersect<CullMode::front, DIMENTIONS, W>(t, packet, object);
+				const Mask hit{ valid & (t >= packet.tMin) & (t < packet.tMax) };
+				hits += JL::simd::Count(hit);
+			}
+		}
+		return hits;
+	}
+
+	struct ShadingInput
+	{
+		WorldVector normal;
+		WorldVector light; // towards the surface, as the renderer passes it
+		WorldVector view;  // towards the surface
+	};
+
+	std::vector<ShadingInput> MakeShadingInputs(Random& random, size_t count)
+	{
+		std::vector<ShadingInput> inputs{};
+		for (size_t i{}; i < count; ++i)
+		{
+			ShadingInput input{ random.NextDirection(), random.NextDirection(), random.NextDirection() };
+			// only lit, visible sides are shaded
+			if (Dot(input.normal, input.light) > 0)
+				input.light = -input.light;
+			if (Dot(input.normal, input.view) > 0)
+				input.view = -input.view;
+			inputs.push_back(input);
+		}
+		return inputs;
+	}
+
+	size_t ShadeCookTorrance(std::vector<ShadingInput> const& inputs)
+	{
+		const Colour fresnelBase{ 1.f, .5f, .8f };
+		ColourValue total{};
+		for (size_t i{}; i < inputs.size(); ++i)
+		{
+			ShadingInput const& input{ inputs[i] };
+			total += JL::Shade_Lambert_CookTorrance(input.normal, input.light, input.view, 1.f, .36f, i % 2 == 0, fresnelBase).x;
+		}
+		return static_cast<size_t>(total);
+	}
+
+	size_t ShadePhong(std::vector<ShadingInput> const& inputs)
+	{
+		ColourValue total{};
+		for (ShadingInput const& input : inputs)
+			total += JL::LMBR::Phong(input.view, Elite::Reflect(input.light, input.normal), 60.f);
+		return static_cast<size_t>(total);
+	}
+
+	// Frame setup and the primary packets of a whole frame, as Renderer::Trace does it
+	template<int W>
+	size_t CameraRays(Camera const& camera, RasterPoint const& size)
+	{
+		const Renderer::FrameSetup frame{ Renderer::SetupFrame(camera, size.x, size.y) };
+
+		size_t rays{};
+		RasterPoint pixels[W]{};
+		WorldVector directions[W]{};
+		for (RasterPoint block{}; block.y < size.y; block.y += Renderer::BLOCK_HEIGHT<W>)
+			for (block.x = 0; block.x < size.x; block.x += Renderer::BLOCK_WIDTH<W>)
+				rays += JL::simd::Count(Renderer::PrimaryPacket(frame, block, size, pixels, directions).active);
+		return rays;
+	}
+
+	//
+	// Timing and output
+	//
+
+	struct Timing
+	{
+		size_t repeats;
+		double seconds;
+	};
+
+	// Runs the kernel once to warm up, then repeats it until minimumSeconds passed
+	template<typename Kernel>
+	Timing Repeat(Kernel const& kernel, double minimumSeconds)
+	{
+		size_t sink{ kernel() };
+		Timing timing{};
+		const Clock::time_point start{ Clock::now() };
+		do
+		{
+			sink += kernel();
+			++timing.repeats;
+			timing.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		} while (timing.seconds < minimumSeconds);
+		g_Sink = sink;
+		return timing;
+	}
+
+	char const* IsaName(int width)
+	{
+		switch (width)
+		{
+		case 1:
+			return "scalar";
+#if defined(JL_SIMD_SSE)
+		case 4:
+			return "sse";
+#endif
+#if defined(JL_SIMD_AVX2)
+		case 8:
+			return "avx2";
+#endif
+#if defined(JL_SIMD_AVX512)
+		case 16:
+			return "avx512";
+#endif
+		default:
+			return "generic"; // plain loops
+		}
+	}
+
+	struct Row
+	{
+		char const* kernel;
+		char const* rayset;
+		int width;
+		size_t rays;  // per repeat
+		size_t tests; // per repeat
+		Timing timing;
+	};
+
+	void Write(std::ostream& output, Row const& row)
+	{
+		const double rays{ double(row.rays) * row.timing.repeats };
+		const double tests{ double(row.tests) * row.timing.repeats };
+		output
+			<< row.kernel << ',' << row.rayset << ',' << IsaName(row.width) << ',' << row.width << ','
+			<< size_t(rays) << ',' << size_t(tests) << ',' << row.timing.seconds << ','
+			<< row.timing.seconds * 1e9 / tests << ',' << rays / row.timing.seconds << '\n';
+	}
+
+	void ScalarRows(std::ostream& output, RaySet const& set, Primitives const& primitives, double minimumSeconds)
+	{
+		const size_t rays{ set.rays.size() };
+		auto const row = [&](char const* kernel, auto const& objects)
+		{
+			const Timing timing{ Repeat([&set, &objects]() { return IntersectScalar(set, objects); }, minimumSeconds) };
+			Write(output, Row{ kernel, set.name, 1, rays, rays * objects.size(), timing });
+		};
+		row("intersect_plane", primitives.planes);
+		row("intersect_sphere", primitives.spheres);
+		row("intersect_triangle", primitives.triangles);
+
+		// tests count the spheres, not the clusters, so the rows compare per sphere
+		const Timing timing{ Repeat([&set, &primitives]() { return IntersectClusters(set, primitives.sphereSet); }, minimumSeconds) };
+		Write(output, Row{ "intersect_sphere_set", set.name, 1, rays, rays * primitives.spheres.size(), timing });
+	}
+
+	template<int W>
+	void PacketRows(std::ostream& output, RaySet const& set, Primitives const& primitives, double minimumSeconds)
+	{
+		const std::vector<RayPacket<W>> packets{ MakePackets<W>(set) };
+		const size_t rays{ packets.size() * W };
+		auto const row = [&](char const* kernel, auto const& objects)
+		{
+			const Timing timing{ Repeat([&packets, &objects]() { return IntersectPacket<W>(packets, objects); }, minimumSeconds) };
+			Write(output, Row{ kernel, set.name, W, rays, rays * objects.size(), timing });
+		};
+		row("intersect_plane", primitives.planes);
+		row("intersect_sphere", primitives.spheres);
+		row("intersect_triangle", primitives.triangles);
+	}
+
+	template<int W>
+	void CameraRow(std::ostream& output, RasterPoint const& size, double minimumSeconds)
+	{
+		const Camera camera{ MakeCamera(size.x, size.y) };
+		const size_t rays{ size.x * size.y };
+		const Timing timing{ Repeat([&camera, &size]() { return CameraRays<W>(camera, size); }, minimumSeconds) };
+		Write(output, Row{ "camera_rays", "frame", W, rays, rays, timing });
+	}
+
+}
+
+void Elite::RunBenchmarks(std::ostream& output, BenchmarkSettings const& settings)
+{
+	Random random{ settings.seed };
+	const Primitives primitives{ MakePrimitives(random, settings.primitiveCount) };
+	const RaySet sets[]{
+		MakeCoherent(settings.rayCount),
+		MakeIncoherent(random, settings.rayCount),
+		MakeShadow(random, settings.rayCount)
+	};
+	const std::vector<ShadingInput> shadingInputs{ MakeShadingInputs(random, settings.rayCount) };
+
+	const int widest{ JL::simd::DetectWidth() };
+	const double seconds{ settings.minimumSeconds };
+
+	output << "kernel,rayset,isa,width,rays,tests,seconds,ns_per_test,rays_per_second\n";
+
+	for (RaySet const& set : sets)
+	{
+		ScalarRows(output, set, primitives, seconds);
+		PacketRows<4>(output, set, primitives, seconds);
+		if (widest >= 8)
+			PacketRows<8>(output, set, primitives, seconds);
+		if (widest >= 16)
+			PacketRows<16>(output, set, primitives, seconds);
+	}
+
+	const size_t shadings{ shadingInputs.size() };
+	Write(output, Row{ "shade_cook_torrance", "random", 1, shadings, shadings, Repeat([&shadingInputs]() { return ShadeCookTorrance(shadingInputs); }, seconds) });
+	Write(output, Row{ "shade_phong", "random", 1, shadings, shadings, Repeat([&shadingInputs]() { return ShadePhong(shadingInputs); }, seconds) });
+
+	const RasterPoint frame{ FrameSize(settings.rayCount) };
+	CameraRow<4>(output, frame, seconds);
+	if (widest >= 8)
+		CameraRow<8>(output, frame, seconds);
+	if (widest >= 16)
+		CameraRow<16>(output, frame, seconds);
+
+	output.flush();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include "RenderUtils.h"
+
+namespace Elite
+{
+
+	struct BenchmarkSettings
+	{
+		uint32_t seed = 2020;        // every ray set and primitive is generated from it
+		size_t rayCount = 128 * 128; // per ray set
+		size_t primitiveCount = 64;  // per intersection kernel
+		double minimumSeconds = .2;  // each kernel repeats until it ran at least this long
+	};
+
+	// Times the hot kernels in isolation: primitive intersection against coherent, incoherent and shadow ray sets,
+	// shading and camera ray setup. Scalar kernels and the packet kernels at every width the cpu supports.
+	// Writes csv, a header followed by one row per kernel, ray set and width:
+	//   kernel,rayset,isa,width,rays,tests,seconds,ns_per_test,rays_per_second
+	void RunBenchmarks(std::ostream& output, BenchmarkSettings const& settings = {});
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <set>
+#include <tuple>
 #include <SDL.h>
 #include "JL/JLMathUtilities.h"
 #include "JL/JLCamera.h"
@@ -89,13 +90,17 @@ public:
 		};
 	};
 
+	// Returns whether the camera moved
 	template<int N, typename T>
-	static void Update(JL::Camera<N, T> & camera, float const deltaT, float const deltaX = 0, float const deltaY = 0, float const deltaWheel = 0)
+	static bool Update(JL::Camera<N, T> & camera, float const deltaT, float const deltaX = 0, float const deltaY = 0, float const deltaWheel = 0)
 	{
 		using Camera = JL::Camera<N, T>;
 		using namespace JL;
 
 		auto const isPressed = MakePollFunction();
+
+		auto const state = [&camera]() { return std::make_tuple(camera.GetPosition(), camera.GetDirection(), camera.GetFieldOfView(), camera.GetFocalLength()); };
+		auto const before{ state() };
 	
 		// Keyboard
 		{
@@ -161,7 +166,7 @@ public:
 				camera.SetFocalLength(camera.GetFocalLength() * pow(1.01, deltaWheel));
 		}
 
-		return;
+		return state() != before;
 	}
 
 private:
@@ -6,6 +6,9 @@
 #include "ERenderer.h"
 #include "ERGBColor.h"
 #include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 using namespace Elite;
 
 //globals... I know
@@ -47,10 +50,9 @@ Elite::Renderer::Renderer(SDL_Window * pWindow)
 	SDL_GetWindowSize(pWindow, &width, &height);
 	m_Width = static_cast<RasterValue>(width);
 	m_Height = static_cast<RasterValue>(height);
-	m_pBackBuffer = SDL_CreateRGBSurface(0, int(m_Width), int(m_Height), 32, 0, 0, 0, 0);
-	m_pBackBufferPixels = static_cast<PixelValue*>(m_pBackBuffer->pixels);
 
 	m_PixelColourVector.resize( m_Width * m_Height );
+	m_Tiles.resize(((m_Width + TILE_SIZE - 1) / TILE_SIZE) * ((m_Height + TILE_SIZE - 1) / TILE_SIZE));
 
 	//Mesh mesh{};
 	//JL::LoadMesh(mesh, R"(triangle.obj)");
@@ -66,6 +68,18 @@ Elite::Renderer::Renderer(SDL_Window * pWindow)
 
 }
 
+Elite::Renderer::Renderer(RasterValue width, RasterValue height)
+	: m_Width{ width }
+	, m_Height{ height }
+{
+	m_PixelColourVector.resize(m_Width * m_Height);
+	m_Tiles.resize(((m_Width + TILE_SIZE - 1) / TILE_SIZE) * ((m_Height + TILE_SIZE - 1) / TILE_SIZE));
+}
+
+Elite::Renderer::~Renderer()
+{
+}
+
 template<typename T, typename ...R>
 T BP(T && c, R const& ...)
 {
@@ -74,206 +88,967 @@ T BP(T && c, R const& ...)
 
 void Elite::Renderer::Render(const Camera& camera, Scene const& scene, RenderSettings const& settings)
 {
+	const ColourValue high{ settings.progressive ? TraceProgressive(camera, scene, settings) : Trace(camera, scene, settings) };
 
-	// some render constants
-	//constexpr bool MAX_TO_ONE = true;
-	ColourValue high{ 0 }; // when max to all, track max value
+	if (!m_pWindow)
+		return;
+
+	// The window surface is replaced when the window is resized
+	m_pFrontBuffer = SDL_GetWindowSurface(m_pWindow);
+	if (!m_pFrontBuffer)
+		return;
+
+	// Normalize all colour values, straight into the window surface
+
+	SDL_LockSurface(m_pFrontBuffer);
+	Resolve(m_pFrontBuffer, 255.f / (settings.maxToAll ? high : 1));
+	SDL_UnlockSurface(m_pFrontBuffer);
+	SDL_UpdateWindowSurface(m_pWindow);
+}
+
+Elite::Renderer::Packer Elite::Renderer::ChoosePacker(SDL_PixelFormat const* pFormat)
+{
+	Packer packer{ pFormat->format, false, JL::simd::DetectShuffle(), {} };
+	if (pFormat->BytesPerPixel != sizeof(PixelValue) || pFormat->Rloss != 0 || pFormat->Gloss != 0 || pFormat->Bloss != 0)
+		return packer;
+	if (pFormat->Rshift % 8 != 0 || pFormat->Gshift % 8 != 0 || pFormat->Bshift % 8 != 0)
+		return packer;
+
+	uint8_t channels[sizeof(PixelValue)]{ JL::simd::PixelLayout::NONE, JL::simd::PixelLayout::NONE, JL::simd::PixelLayout::NONE, JL::simd::PixelLayout::NONE };
+	channels[pFormat->Rshift / 8] = 0;
+	channels[pFormat->Gshift / 8] = 1;
+	channels[pFormat->Bshift / 8] = 2;
+	packer.direct = true;
+	packer.layout = JL::simd::PixelLayout::Make(channels, pFormat->Amask); // opaque, as SDL_MapRGB
+	return packer;
+}
+
+void Elite::Renderer::Resolve(SDL_Surface* pSurface, ColourValue factor)
+{
+	if (pSurface->format->format != m_Packer.format)
+		m_Packer = ChoosePacker(pSurface->format);
 
-	// Setup values
+	const RasterValue width{ std::min(m_Width, static_cast<RasterValue>(pSurface->w)) };
+	const RasterValue height{ std::min(m_Height, static_cast<RasterValue>(pSurface->h)) };
+	const RasterValue tiles{ ((width + TILE_SIZE - 1) / TILE_SIZE) * ((height + TILE_SIZE - 1) / TILE_SIZE) };
 
-	SDL_LockSurface(m_pBackBuffer);
+	m_ThreadPool.ParallelFor(
+		tiles,
+		[this, pSurface, factor, width, height](size_t tile, size_t)
+		{
+			RasterPoint from{}, to{};
+			GetTileBounds(tile, width, height, from, to);
+			for (RasterValue y{ from.y }; y < to.y; ++y)
+			{
+				Colour const* const colours{ &m_PixelColourVector[from.x + y * m_Width] };
+				uint8_t* const row{ static_cast<uint8_t*>(pSurface->pixels) + y * pSurface->pitch };
+				const RasterValue count{ to.x - from.x };
 
+				if (!m_Packer.direct)
+				{
+					const uint8_t bytes{ pSurface->format->BytesPerPixel };
+					for (RasterValue x{}; x < count; ++x)
+					{
+						auto const channel = [factor](ColourValue value) { return static_cast<PixelSubValue>(std::clamp(value * factor, 0.f, 255.f)); };
+						const PixelValue pixel{ SDL_MapRGB(pSurface->format, channel(colours[x].r), channel(colours[x].g), channel(colours[x].b)) };
+						std::memcpy(row + (from.x + x) * bytes, &pixel, bytes); // the low bytes, on little endian machines
+					}
+					continue;
+				}
+
+				PixelValue* const pixels{ reinterpret_cast<PixelValue*>(row) + from.x };
+				if (!m_Packer.shuffle)
+				{
+					ResolveRow<1>(colours, pixels, count, factor, m_Packer.layout);
+					continue;
+				}
+
+				switch (m_PacketWidth)
+				{
+				case 16:
+					ResolveRow<16>(colours, pixels, count, factor, m_Packer.layout);
+					break;
+				case 8:
+					ResolveRow<8>(colours, pixels, count, factor, m_Packer.layout);
+					break;
+				default:
+					ResolveRow<4>(colours, pixels, count, factor, m_Packer.layout);
+					break;
+				}
+			}
+		}
+	);
+}
+
+template<int W>
+void Elite::Renderer::ResolveRow(Colour const* colours, PixelValue* pixels, RasterValue count, ColourValue factor, JL::simd::PixelLayout const& layout)
+{
+	using Lanes = JL::simd::Lanes<W>;
+	static_assert(sizeof(Colour) == 3 * sizeof(ColourValue), "colours are read as consecutive channel values");
+
+	// W colours are 3 * W values. Scaling and clamping treat every channel alike, so they need no deinterleaving
+	ColourValue const* const values{ colours->data };
+	const Lanes scale{ Lanes::Broadcast(factor) };
+	const Lanes low{ Lanes::Broadcast(0.f) };
+	const Lanes high{ Lanes::Broadcast(255.f) };
+
+	RasterValue pixel{};
+	for (; pixel + W <= count; pixel += W)
+	{
+		Lanes channels[3];
+		for (int i{}; i < 3; ++i)
+			channels[i] = Min(Max(Lanes::Load(values + 3 * pixel + i * W) * scale, low), high);
+		JL::simd::Pack(channels, layout, pixels + pixel);
+	}
+
+	if constexpr (W > 1)
+		ResolveRow<1>(colours + pixel, pixels + pixel, count - pixel, factor, layout);
+}
+
+Elite::Renderer::FrameSetup Elite::Renderer::SetupFrame(const Camera& camera, RasterValue width, RasterValue height)
+{
 	ScreenPoint screenPoint{}; // tmp value
-	Ray ray{ camera.GetRayOrigin() }; // main cast ray
+	FrameSetup frame{ camera.GetRayOrigin() };
 
 	// origin point
-	RasterToScreen(screenPoint , RasterPoint{ 0,0 }, m_Width, m_Height);
+	RasterToScreen(screenPoint , RasterPoint{ 0,0 }, width, height);
 	
-	// x increment for main loop
-	WorldVector xIncrement{
-		RasterToScreen(RasterPoint{ 1,0 }, m_Width, m_Height) - screenPoint
+	// x increment per pixel
+	frame.xIncrement = WorldVector{
+		RasterToScreen(RasterPoint{ 1,0 }, width, height) - screenPoint
 	};
-	camera.ViewToWorld(xIncrement);
+	camera.ViewToWorld(frame.xIncrement);
 	
-	// y increment for main loop
-	WorldVector yIncrement{
-		RasterToScreen(RasterPoint{ 0,1 }, m_Width, m_Height) - screenPoint
+	// y increment per pixel
+	frame.yIncrement = WorldVector{
+		RasterToScreen(RasterPoint{ 0,1 }, width, height) - screenPoint
 	};
-	camera.ViewToWorld(yIncrement);
-
-	// (x * width + y) increment for return in main loop
-	WorldVector yRetun{ xIncrement * -static_cast<WorldValue>(m_Width) + yIncrement };
+	camera.ViewToWorld(frame.yIncrement);
 	
-	// setup origin ray
-	ray.direction = {
+	// direction through the origin pixel
+	frame.direction = {
 		screenPoint.x,
 		screenPoint.y,
 		static_cast<WorldValue>(1)
 	};
-	camera.ViewToWorld(ray.direction);
-	
-	// default colour = black
-	const Colour defaultColour{};
-	
-	//
-	// MAIN LOOP: Casting ray for each pixel
-	//
-	for (RasterPoint point{}; point.y < m_Height; ray.direction += yRetun, ++point.y)
+	camera.ViewToWorld(frame.direction);
+
+	return frame;
+}
+
+ColourValue Elite::Renderer::Trace(const Camera& camera, Scene const& scene, RenderSettings const& settings)
+{
+	for (JL::TraversalCounter& counter : m_TraversalCounters)
+		counter.Reset();
+	const FrameSetup frame{ SetupFrame(camera, m_Width, m_Height) };
+	UpdateDirtyTiles(frame, scene, settings);
+	BuildLightLists(frame, m_Width, m_Height, scene, settings);
+	PrecomputeOrigins(frame, scene, settings);
+
+	// Only tiles something changed in are traced again, the others keep last frame's pixels
+
+	std::vector<size_t> dirty{};
+	for (size_t tile : GetTileOrder(m_Width, m_Height, settings.order))
+		if (m_Tiles[tile].dirty)
+			dirty.push_back(tile);
+
+	const Target target{ m_PixelColourVector.data(), m_Width, m_Height };
+	const TileKernel kernel{ ChooseKernel(settings) };
+	m_ThreadPool.ParallelFor(
+		dirty.size(),
+		[this, kernel, &dirty, &frame, &target, &scene, &settings](size_t index, size_t worker)
+		{
+			TileState& state{ m_Tiles[dirty[index]] };
+			state.high = TraceTile(kernel, dirty[index], worker, 0, frame, target, scene, settings);
+			state.dirty = false;
+		}
+	);
+
+	return GetHigh();
+}
+
+// Halton sequence: low discrepancy values in [0, 1)
+static WorldValue Halton(size_t index, size_t base)
+{
+	WorldValue result{ 0 };
+	WorldValue fraction{ 1 };
+	for (; index != 0; index /= base)
+	{
+		fraction /= static_cast<WorldValue>(base);
+		result += fraction * static_cast<WorldValue>(index % base);
+	}
+	return result;
+}
+
+// Uniform value in [0, 1) hashed from the keys, unrelated between neighbouring keys. PCG hash, chained
+static WorldValue Random(uint32_t first, uint32_t second, uint32_t third, uint32_t fourth)
+{
+	auto const hash = [](uint32_t value)
+	{
+		const uint32_t state{ value * 747796405u + 2891336453u };
+		const uint32_t word{ ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u };
+		return (word >> 22u) ^ word;
+	};
+	return static_cast<WorldValue>(hash(first + hash(second + hash(third + hash(fourth)))) >> 8) / static_cast<WorldValue>(1u << 24);
+}
+
+void Elite::Renderer::Restart(bool preview) noexcept
+{
+	m_SampleCount = 0;
+	m_PreviewScale = preview ? PREVIEW_SCALE : 1;
+	for (TileState& state : m_Tiles)
+		state.dirty = true;
+}
+
+ColourValue Elite::Renderer::TraceProgressive(const Camera& camera, Scene const& scene, RenderSettings const& settings)
+{
+	for (JL::TraversalCounter& counter : m_TraversalCounters)
+		counter.Reset();
+	FrameSetup frame{ SetupFrame(camera, m_Width, m_Height) };
+	UpdateDirtyTiles(frame, scene, settings);
+	PrecomputeOrigins(frame, scene, settings); // previews and jittered samples keep the origin
+	const TileKernel kernel{ ChooseKernel(settings) };
+
+	if (m_PreviewScale > 1)
 	{
-		for (point.x = 0; point.x < m_Width; ray.direction += xIncrement, ++point.x)
+		// Coarse preview: one ray through the centre of every scale x scale block of pixels, the whole block takes its colour.
+		// Tiles stay dirty, the first full resolution sample restarts them
+
+		const RasterValue scale{ m_PreviewScale };
+		const RasterValue width{ (m_Width + scale - 1) / scale };
+		const RasterValue height{ (m_Height + scale - 1) / scale };
+
+		frame.direction += (frame.xIncrement + frame.yIncrement) * (static_cast<WorldValue>(scale - 1) / 2);
+		frame.xIncrement *= static_cast<WorldValue>(scale);
+		frame.yIncrement *= static_cast<WorldValue>(scale);
+
+		m_PreviewColourVector.resize(width * height);
+		const Target target{ m_PreviewColourVector.data(), width, height };
+		BuildLightLists(frame, width, height, scene, settings);
+		std::vector<size_t> const& tiles{ GetTileOrder(width, height, settings.order) };
+
+		std::vector<ColourValue> highs(m_ThreadPool.GetWorkerCount(), ColourValue{ 0 }); // when max to all, track max value per worker
+		m_ThreadPool.ParallelFor(
+			tiles.size(),
+			[this, kernel, &tiles, &frame, &target, &scene, &settings, &highs](size_t index, size_t worker)
+			{
+				highs[worker] = std::max(highs[worker], TraceTile(kernel, tiles[index], worker, 0, frame, target, scene, settings));
+			}
+		);
+
+		for (RasterValue y{}; y < m_Height; ++y)
+			for (RasterValue x{}; x < m_Width; ++x)
+				m_PixelColourVector[x + y * m_Width] = m_PreviewColourVector[x / scale + y / scale * width];
+
+		m_PreviewScale /= 2;
+		return *std::max_element(begin(highs), end(highs));
+	}
+
+	// Full resolution sample per tile. Dirty tiles start over, the others add a sample to their average
+
+	m_AccumulationVector.resize(m_PixelColourVector.size());
+	const Target target{ m_PixelColourVector.data(), m_Width, m_Height };
+	BuildLightLists(frame, m_Width, m_Height, scene, settings);
+
+	std::vector<size_t> const& tiles{ GetTileOrder(m_Width, m_Height, settings.order) };
+	m_ThreadPool.ParallelFor(
+		tiles.size(),
+		[this, kernel, &tiles, &frame, &target, &scene, &settings](size_t index, size_t worker)
 		{
-			// per pixel variables
+			const size_t tile{ tiles[index] };
+			TileState& state{ m_Tiles[tile] };
+			if (state.dirty)
+				state = TileState{ false, 0, 0 };
 
-			ObjectContainer::PtrVariant hitObject{};
-			Colour lightColour{};
-			Intersection t{ Ray::tMax };
+			// The first sample goes through the pixel centres like Trace, the next ones are jittered within the pixel
+			FrameSetup jittered{ frame };
+			if (state.samples != 0)
+				jittered.direction += frame.xIncrement * (Halton(state.samples, 2) - .5f) + frame.yIncrement * (Halton(state.samples, 3) - .5f);
 
-			// First hit loop function
-			
-			JL::Visitor const hitFunction{
-				[&t, &ray, &hitObject](auto const& object)
+			// The highest sample is an upper bound for the highest average
+			state.high = std::max(state.high, TraceTile(kernel, tile, worker, state.samples, jittered, target, scene, settings));
+			++state.samples;
+
+			RasterPoint from{}, to{};
+			GetTileBounds(tile, m_Width, m_Height, from, to);
+			const ColourValue weight{ 1.f / static_cast<ColourValue>(state.samples) };
+			for (RasterValue y{ from.y }; y < to.y; ++y)
+			{
+				for (RasterValue x{ from.x }; x < to.x; ++x)
 				{
-					if (object.cullmode == JL::CullMode::none)
-						return;
-					Intersection intersection;
-					if (Intersect(intersection, ray, object, object.cullmode) && intersection < t)
-					{
-						t = intersection;
-						hitObject = &object;
-					}
+					Colour& sum{ m_AccumulationVector[x + y * m_Width] };
+					Colour& pixel{ m_PixelColourVector[x + y * m_Width] };
+					sum = state.samples == 1 ? pixel : sum + pixel;
+					pixel = sum * weight;
+				}
+			}
+		}
+	);
+	++m_SampleCount;
+
+	return GetHigh();
+}
+
+void Elite::Renderer::Invalidate(Box const& bounds)
+{
+	m_Changes.push_back(bounds);
+}
+
+void Elite::Renderer::GetTileBounds(size_t tile, RasterValue width, RasterValue height, RasterPoint& from, RasterPoint& to)
+{
+	const RasterValue tilesX{ (width + TILE_SIZE - 1) / TILE_SIZE };
+	from = RasterPoint{ (tile % tilesX) * TILE_SIZE, (tile / tilesX) * TILE_SIZE };
+	to = RasterPoint{ std::min(from.x + TILE_SIZE, width), std::min(from.y + TILE_SIZE, height) };
+}
+
+template<int W, int... Combinations>
+Elite::Renderer::TileKernel Elite::Renderer::GetKernel(int combination, std::integer_sequence<int, Combinations...>)
+{
+	static constexpr TileKernel kernels[]{ &Renderer::RenderTile<W, (Combinations & 1) != 0, (Combinations & 2) != 0, (Combinations & 4) != 0>... };
+	return kernels[combination];
+}
+
+Elite::Renderer::TileKernel Elite::Renderer::ChooseKernel(RenderSettings const& settings) const
+{
+	const int combination{ (settings.PBR ? 1 : 0) | (settings.hardShadows ? 2 : 0) | (settings.maxToAll ? 4 : 0) };
+	switch (m_PacketWidth)
+	{
+	case 16:
+		return GetKernel<16>(combination, std::make_integer_sequence<int, 8>{});
+	case 8:
+		return GetKernel<8>(combination, std::make_integer_sequence<int, 8>{});
+	default:
+		return GetKernel<4>(combination, std::make_integer_sequence<int, 8>{});
+	}
+}
+
+ColourValue Elite::Renderer::TraceTile(TileKernel kernel, size_t tile, size_t worker, size_t sample, FrameSetup const& frame, Target const& target, Scene const& scene, RenderSettings const& settings)
+{
+	RasterPoint from{}, to{};
+	GetTileBounds(tile, target.width, target.height, from, to);
+	const JL::TraversalCounter::Scope counting{ m_TraversalCounters.empty() ? nullptr : &m_TraversalCounters[worker] };
+	return (this->*kernel)(tile, sample, from, to, frame, target, scene, settings);
+}
+
+void Elite::Renderer::PrecomputeOrigins(FrameSetup const& frame, Scene const& scene, RenderSettings const& settings)
+{
+	scene.hierarchy.Precompute(m_CameraOrigin, frame.origin);
+
+	// Sampled lights cast their shadow rays from the surfaces instead
+	auto const& lights{ scene.lights.Get<WorldObject<PointLight>>() };
+	m_LightOrigins.resize(settings.hardShadows && settings.lightSamples == 0 ? lights.size() : 0);
+	m_ThreadPool.ParallelFor(
+		m_LightOrigins.size(),
+		[this, &scene, &lights](size_t light, size_t)
+		{
+			scene.hierarchy.Precompute(m_LightOrigins[light], lights[light].position);
+		}
+	);
+}
+
+std::vector<RasterPoint> Elite::Renderer::Order(RasterValue columns, RasterValue rows, PixelOrder order)
+{
+	const uint32_t size{ JL::CeilPowerOfTwo(static_cast<uint32_t>(std::max(columns, rows))) };
+	auto const index = [order, columns, size](RasterPoint const& cell) -> uint32_t
+	{
+		const uint32_t x{ static_cast<uint32_t>(cell.x) }, y{ static_cast<uint32_t>(cell.y) };
+		switch (order)
+		{
+		case PixelOrder::morton:
+			return JL::MortonIndex(x, y);
+		case PixelOrder::hilbert:
+			return JL::HilbertIndex(x, y, size);
+		default:
+			return x + y * static_cast<uint32_t>(columns);
+		}
+	};
+
+	// Cells of the power of two square the curve runs through that are outside the grid are skipped
+	std::vector<RasterPoint> cells{};
+	cells.reserve(columns * rows);
+	for (RasterValue y{}; y < rows; ++y)
+		for (RasterValue x{}; x < columns; ++x)
+			cells.push_back(RasterPoint{ x, y });
+	std::sort(begin(cells), end(cells), [&index](RasterPoint const& a, RasterPoint const& b) { return index(a) < index(b); });
+	return cells;
+}
+
+std::vector<size_t> const& Elite::Renderer::GetTileOrder(RasterValue width, RasterValue height, PixelOrder order)
+{
+	for (TileOrder const& tileOrder : m_TileOrders)
+		if (tileOrder.width == width && tileOrder.height == height && tileOrder.order == order)
+			return tileOrder.tiles;
+
+	const RasterValue tilesX{ (width + TILE_SIZE - 1) / TILE_SIZE };
+	const RasterValue tilesY{ (height + TILE_SIZE - 1) / TILE_SIZE };
+	TileOrder& tileOrder{ m_TileOrders.emplace_back(TileOrder{ width, height, order, {} }) };
+	for (RasterPoint const& tile : Order(tilesX, tilesY, order))
+		tileOrder.tiles.push_back(tile.x + tile.y * tilesX);
+	return tileOrder.tiles;
+}
+
+template<int W>
+std::vector<RasterPoint> const& Elite::Renderer::GetBlockOrder(PixelOrder order)
+{
+	auto const blocks = [](PixelOrder order)
+	{
+		std::vector<RasterPoint> offsets{ Order(TILE_SIZE / BLOCK_WIDTH<W>, TILE_SIZE / BLOCK_HEIGHT<W>, order) };
+		for (RasterPoint& offset : offsets)
+			offset = RasterPoint{ offset.x * BLOCK_WIDTH<W>, offset.y * BLOCK_HEIGHT<W> };
+		return offsets;
+	};
+	static const std::vector<RasterPoint> orders[]{ blocks(PixelOrder::scanline), blocks(PixelOrder::morton), blocks(PixelOrder::hilbert) };
+	return orders[static_cast<size_t>(order)];
+}
+
+void Elite::Renderer::SetTraversalCounting(bool counting)
+{
+	m_TraversalCounters.clear();
+	if (counting)
+		m_TraversalCounters.resize(m_ThreadPool.GetWorkerCount());
+}
+
+Elite::Renderer::TraversalStats Elite::Renderer::GetTraversalStats() const
+{
+	TraversalStats stats{};
+	for (JL::TraversalCounter const& counter : m_TraversalCounters)
+	{
+		stats.rays += counter.GetRays();
+		stats.visits += counter.GetVisits();
+		stats.misses += counter.GetMisses();
+	}
+	return stats;
+}
+
+ColourValue Elite::Renderer::GetHigh() const
+{
+	ColourValue high{ 0 };
+	for (TileState const& state : m_Tiles)
+		high = std::max(high, state.high);
+	return high;
+}
+
+// Raster position an offset from the camera origin projects to.
+// False when the offset does not point in front of the camera
+static bool ProjectToRaster(Elite::Renderer::FrameSetup const& frame, WorldVector const& offset, WorldValue& x, WorldValue& y)
+{
+	// offset = a * (direction + x * xIncrement + y * yIncrement), solved for a, a * x and a * y with Cramer's rule
+	const WorldVector normal{ Cross(frame.xIncrement, frame.yIncrement) };
+	const WorldValue determinant{ Dot(frame.direction, normal) };
+	const WorldValue a{ Dot(offset, normal) / determinant };
+	if (!(a > 0))
+		return false;
+	x = Dot(frame.direction, Cross(offset, frame.yIncrement)) / determinant / a;
+	y = Dot(frame.direction, Cross(frame.xIncrement, offset)) / determinant / a;
+	return true;
+}
+
+void Elite::Renderer::UpdateDirtyTiles(FrameSetup const& frame, Scene const& scene, RenderSettings const& settings)
+{
+	// Another camera, scene or setting changes every pixel
+	const bool unchanged{
+		&scene == m_pLastScene &&
+		frame.origin == m_LastFrame.origin && frame.direction == m_LastFrame.direction &&
+		frame.xIncrement == m_LastFrame.xIncrement && frame.yIncrement == m_LastFrame.yIncrement &&
+		settings.PBR == m_LastSettings.PBR && settings.hardShadows == m_LastSettings.hardShadows &&
+		settings.maxToAll == m_LastSettings.maxToAll && settings.progressive == m_LastSettings.progressive &&
+		settings.lightCutoff == m_LastSettings.lightCutoff && settings.lightSamples == m_LastSettings.lightSamples
+	};
+	m_pLastScene = &scene;
+	m_LastFrame = frame;
+	m_LastSettings = settings;
+
+	if (!unchanged)
+	{
+		for (TileState& state : m_Tiles)
+			state.dirty = true;
+		m_Changes.clear();
+		return;
+	}
+
+	for (Box const& bounds : m_Changes)
+	{
+		// Screen bounds of the box and, with shadows, of the shadows it can cast: the part of the cone from a point light through the box beyond it,
+		// the box swept along a directional light. Their outlines are the projected corners and the points the sweep directions vanish to.
+		// Whatever reaches behind the camera plane can show anywhere
+
+		WorldValue low[2]{ FLT_MAX, FLT_MAX };
+		WorldValue high[2]{ -FLT_MAX, -FLT_MAX };
+		bool bounded{ !bounds.IsEmpty() };
+
+		auto const add = [&frame, &low, &high, &bounded](WorldVector const& offset)
+		{
+			WorldValue x{}, y{};
+			bounded = bounded && ProjectToRaster(frame, offset, x, y);
+			low[0] = std::min(low[0], x);
+			low[1] = std::min(low[1], y);
+			high[0] = std::max(high[0], x);
+			high[1] = std::max(high[1], y);
+		};
+
+		WorldPoint corners[8]{};
+		for (int corner{}; corner < 8; ++corner)
+		{
+			for (int axis{}; axis < 3; ++axis)
+				corners[corner].data[axis] = ((corner >> axis) & 1) ? bounds.max.data[axis] : bounds.min.data[axis];
+			add(corners[corner] - frame.origin);
+		}
+
+		if (settings.hardShadows)
+		{
+			JL::Visitor const shadowFunction{
+				// Point light
+				[&add, &bounded, &bounds, &corners](WorldObject<PointLight> const& source)
+				{
+					// a light inside the box shadows in every direction
+					bool inside{ true };
+					for (int axis{}; axis < 3; ++axis)
+						inside = inside && source.position.data[axis] >= bounds.min.data[axis] && source.position.data[axis] <= bounds.max.data[axis];
+					bounded = bounded && !inside;
+					for (WorldPoint const& corner : corners)
+						add(corner - source.position);
+				},
+				// Directional light
+				[&add](WorldObject<DirectionalLight> const& source)
+				{
+					add(source.direction);
 				}
 			};
+			scene.lights.ForEach(shadowFunction);
+		}
+
+		if (!bounded || !std::isfinite(low[0]) || !std::isfinite(low[1]) || !std::isfinite(high[0]) || !std::isfinite(high[1]))
+		{
+			for (TileState& state : m_Tiles)
+				state.dirty = true;
+			continue;
+		}
+
+		RasterPoint first{}, last{};
+		if (!GetTileRange(low, high, m_Width, m_Height, first, last))
+			continue; // off screen
+
+		const RasterValue tilesX{ (m_Width + TILE_SIZE - 1) / TILE_SIZE };
+		for (RasterValue y{ first.y }; y <= last.y; ++y)
+			for (RasterValue x{ first.x }; x <= last.x; ++x)
+				m_Tiles[x + y * tilesX].dirty = true;
+	}
+	m_Changes.clear();
+}
+
+bool Elite::Renderer::GetTileRange(WorldValue const (&low)[2], WorldValue const (&high)[2], RasterValue width, RasterValue height, RasterPoint& first, RasterPoint& last)
+{
+	// a pixel of margin: samples are jittered by half a pixel, previews are blocks around their pixel
+	const WorldValue fromX{ std::floor(low[0]) - 1 }, fromY{ std::floor(low[1]) - 1 };
+	const WorldValue toX{ std::ceil(high[0]) + 2 }, toY{ std::ceil(high[1]) + 2 };
+	if (toX <= 0 || toY <= 0 || fromX >= static_cast<WorldValue>(width) || fromY >= static_cast<WorldValue>(height))
+		return false;
+
+	const RasterValue tilesX{ (width + TILE_SIZE - 1) / TILE_SIZE };
+	const RasterValue tilesY{ (height + TILE_SIZE - 1) / TILE_SIZE };
+	first = RasterPoint{ static_cast<RasterValue>(std::max(fromX, 0.f)) / TILE_SIZE, static_cast<RasterValue>(std::max(fromY, 0.f)) / TILE_SIZE };
+	last = RasterPoint{
+		std::min(static_cast<RasterValue>(std::min(toX, static_cast<WorldValue>(width))) / TILE_SIZE, tilesX - 1),
+		std::min(static_cast<RasterValue>(std::min(toY, static_cast<WorldValue>(height))) / TILE_SIZE, tilesY - 1)
+	};
+	return true;
+}
+
+void Elite::Renderer::BuildLightLists(FrameSetup const& frame, RasterValue width, RasterValue height, Scene const& scene, RenderSettings const& settings)
+{
+	auto const& lights{ scene.lights.Get<WorldObject<PointLight>>() };
+	const RasterValue tilesX{ (width + TILE_SIZE - 1) / TILE_SIZE };
+	const RasterValue tilesY{ (height + TILE_SIZE - 1) / TILE_SIZE };
+	const size_t tiles{ tilesX * tilesY };
+
+	// Tiles every light reaches: the projected corners of the box around its influence sphere.
+	// Spheres reaching behind the camera plane, or without bound, can light any tile
+
+	std::vector<RasterPoint> firsts(lights.size()), lasts(lights.size());
+	std::vector<size_t>& offsets{ m_LightLists.offsets };
+	offsets.assign(tiles + 1, 0);
+	m_LightLists.squareRadii.resize(lights.size());
+
+	for (size_t light{}; light < lights.size(); ++light)
+	{
+		const WorldValue radius{ JL::InfluenceRadius(lights[light], settings.lightCutoff) };
+		m_LightLists.squareRadii[light] = radius * radius;
+
+		WorldValue low[2]{ FLT_MAX, FLT_MAX };
+		WorldValue high[2]{ -FLT_MAX, -FLT_MAX };
+		bool bounded{ std::isfinite(radius) };
+		for (int corner{}; corner < 8 && bounded; ++corner)
+		{
+			WorldPoint point{ lights[light].position };
+			for (int axis{}; axis < 3; ++axis)
+				point.data[axis] += ((corner >> axis) & 1) ? radius : -radius;
+
+			WorldValue x{}, y{};
+			bounded = ProjectToRaster(frame, point - frame.origin, x, y);
+			low[0] = std::min(low[0], x);
+			low[1] = std::min(low[1], y);
+			high[0] = std::max(high[0], x);
+			high[1] = std::max(high[1], y);
+		}
+
+		if (!bounded)
+		{
+			firsts[light] = RasterPoint{ 0, 0 };
+			lasts[light] = RasterPoint{ tilesX - 1, tilesY - 1 };
+		}
+		else if (!GetTileRange(low, high, width, height, firsts[light], lasts[light]))
+		{
+			firsts[light] = RasterPoint{ 1, 1 }; // an empty range: no tile
+			lasts[light] = RasterPoint{ 0, 0 };
+		}
+
+		for (RasterValue y{ firsts[light].y }; y <= lasts[light].y; ++y)
+			for (RasterValue x{ firsts[light].x }; x <= lasts[light].x; ++x)
+				++offsets[x + y * tilesX + 1];
+	}
+
+	// Counts to offsets, then every tile's list in light order so lights add up in the same order everywhere
+
+	for (size_t tile{}; tile < tiles; ++tile)
+		offsets[tile + 1] += offsets[tile];
+	m_LightLists.indices.resize(offsets.back());
+
+	std::vector<size_t> ends(offsets.begin(), offsets.end() - 1);
+	for (size_t light{}; light < lights.size(); ++light)
+		for (RasterValue y{ firsts[light].y }; y <= lasts[light].y; ++y)
+			for (RasterValue x{ firsts[light].x }; x <= lasts[light].x; ++x)
+				m_LightLists.indices[ends[x + y * tilesX]++] = static_cast<uint32_t>(light);
+}
+
+template<int W>
+RayPacket<W> Elite::Renderer::PrimaryPacket(FrameSetup const& frame, RasterPoint const& block, RasterPoint const& to, RasterPoint (&pixels)[W], WorldVector (&directions)[W])
+{
+	uint32_t inside{};
+	for (int lane{}; lane < W; ++lane)
+	{
+		pixels[lane] = RasterPoint{ block.x + lane % BLOCK_WIDTH<W>, block.y + lane / BLOCK_WIDTH<W> };
+		if (pixels[lane].x < to.x && pixels[lane].y < to.y)
+			inside |= 1u << lane;
+		// every pixel computes its own direction, the result does not depend on the order pixels are traced in
+		directions[lane] = frame.direction + frame.xIncrement * static_cast<WorldValue>(pixels[lane].x) + frame.yIncrement * static_cast<WorldValue>(pixels[lane].y);
+	}
+
+	return RayPacket<W>{ frame.origin, directions, Ray::tMin, Ray::tMax, JL::simd::Mask<W>::FromBits(inside) };
+}
+
+template RayPacket<4> Elite::Renderer::PrimaryPacket<4>(FrameSetup const&, RasterPoint const&, RasterPoint const&, RasterPoint (&)[4], WorldVector (&)[4]);
+template RayPacket<8> Elite::Renderer::PrimaryPacket<8>(FrameSetup const&, RasterPoint const&, RasterPoint const&, RasterPoint (&)[8], WorldVector (&)[8]);
+template RayPacket<16> Elite::Renderer::PrimaryPacket<16>(FrameSetup const&, RasterPoint const&, RasterPoint const&, RasterPoint (&)[16], WorldVector (&)[16]);
+
+template<int W, bool PBR, bool hardShadows, bool maxToAll>
+ColourValue Elite::Renderer::RenderTile(size_t tile, size_t sample, RasterPoint const& from, RasterPoint const& to, FrameSetup const& frame, Target const& target, Scene const& scene, RenderSettings const& settings)
+{
+	using Lanes = JL::simd::Lanes<W>;
+	using Mask = JL::simd::Mask<W>;
+	using Packet = RayPacket<W>;
+
+	ColourValue high{ 0 }; // when max to all, track max value
+
+	// default colour = black
+	const Colour defaultColour{};
+
+	// Shadow query for every active lane of a packet, pShared when they all start at the point it was computed for
+	auto const occluded = [&scene](Packet const& packet, ObjectHierarchy::SharedOrigin const* pShared) -> Mask
+	{
+		Lanes tMax{ packet.tMax };
+		return scene.hierarchy.template Traverse<true>(
+			packet, tMax, packet.active, pShared,
+			[&packet](auto const& object, ObjectHierarchy::Primitive const&, Lanes& tMax, Mask active, float const* pOriginTerm) -> Mask
+			{
+				return JL::Occluded<CullMode::both>(packet, object, tMax, active, pOriginTerm);
+			}
+		);
+	};
+
+	// The point lights that can reach the tile, with the square of their reach and their origin terms if any, then every directional light
+	auto const forEachLight = [this, tile, &scene](auto const& function)
+	{
+		auto const& pointLights{ scene.lights.template Get<WorldObject<PointLight>>() };
+		for (size_t i{ m_LightLists.offsets[tile] }; i < m_LightLists.offsets[tile + 1]; ++i)
+		{
+			const uint32_t light{ m_LightLists.indices[i] };
+			function(pointLights[light], m_LightLists.squareRadii[light], m_LightOrigins.empty() ? nullptr : &m_LightOrigins[light]);
+		}
+		for (WorldObject<DirectionalLight> const& source : scene.lights.template Get<WorldObject<DirectionalLight>>())
+			function(source);
+	};
+
+	for (RasterPoint const& offset : GetBlockOrder<W>(settings.order))
+	{
+		const RasterPoint block{ from.x + offset.x, from.y + offset.y };
+		if (block.x >= to.x || block.y >= to.y)
+			continue; // tiles at the right and bottom edge are cut off
+
+		// per block variables, one lane per pixel. Lanes outside the tile stay inactive
+
+		RasterPoint pixels[W]{};
+		WorldVector directions[W]{};
+		const Packet packet{ PrimaryPacket(frame, block, to, pixels, directions) };
+		JL::TraversalCounter::CountRays(JL::simd::Count(packet.active));
+
+		// First hit
+
+		PacketIntersection<W> hit{ packet.tMax };
+		ObjectHierarchy::Primitive hitPrimitives[W]{};
+		Lanes tMax{ packet.tMax };
+
+		const Mask found{ scene.hierarchy.Traverse(
+			packet, tMax, packet.active, &m_CameraOrigin,
+			[&packet, &hit, &hitPrimitives](auto const& object, ObjectHierarchy::Primitive const& primitive, Lanes& tMax, Mask active, float const* pOriginTerm) -> Mask
+			{
+				const Mask hits{ JL::Intersect(hit, packet, object, primitive.cullmode, tMax, active, pOriginTerm) };
+				tMax = Select(hits, hit.t, tMax);
+				JL::simd::ForEachLane(hits, [&hitPrimitives, &primitive](int lane) { hitPrimitives[lane] = primitive; });
+				return hits;
+			}
+		) };
+
+		// Register hit information
+
+		float distances[W], us[W], vs[W];
+		hit.t.Store(distances);
+		hit.u.Store(us);
+		hit.v.Store(vs);
+
+		struct HitInfo {
+			WorldPoint position;
+			WorldVector surfaceNormal;
+			WorldVector incommingRayDirection;
+			SurfaceData const* surface;
+		} hitInfos[W]{};
+		Colour lightColours[W]{};
+
+		JL::simd::ForEachLane(
+			found,
+			[&](int lane)
+			{
+				const Intersection t{ distances[lane], hit.hitFace[lane], us[lane], vs[lane] };
+				const Ray ray{ frame.origin, directions[lane] };
+				hitInfos[lane].position = ray(t);
+				hitInfos[lane].surfaceNormal = GetNormalized(GetNormal(scene.hierarchy, hitPrimitives[lane], hitInfos[lane].position, t, ray.direction));
+				hitInfos[lane].incommingRayDirection = GetNormalized(ray.direction);
+				hitInfos[lane].surface = &scene.hierarchy.GetMaterial(hitPrimitives[lane]);
+			}
+		);
+
+		// Direct lighting calculation function
 
-			scene.objects.ForEach(hitFunction);
+		// weight scales the light's contribution, for lights that stand in for others
+
+		auto const shadeCalc = [&lightColours, &hitInfos](int lane, auto const& lightSource, WorldVector const& distance, WorldValue weight)
+		{
+			HitInfo const& hitInfo{ hitInfos[lane] };
+			Colour& lightColour{ lightColours[lane] };
+
+			const WorldValue squareDistance{ SqrMagnitude(distance) };
+			const WorldVector light = distance / sqrt(squareDistance);
 			
-			// When hit
-			if (t < Ray::tMax)
+			if constexpr (!PBR)
+			// LMBR
 			{
+				const WorldVector reflection = Elite::Reflect(light, hitInfo.surfaceNormal);
 
-				// Register hit information
+				WorldValue intensity{};
+				intensity += hitInfo.surface->roughness * JL::LMBR::LambertCosine(light, hitInfo.surfaceNormal);
+				intensity += (1 - hitInfo.surface->roughness) * JL::LMBR::Phong(hitInfo.incommingRayDirection, reflection, 60.f);
 
-				const WorldPoint hitPoint{ ray(t) };
-				struct HitInfo {
-					WorldPoint const& position;
-					WorldVector const surfaceNormal;
-					WorldVector const& incommingRayDirection;
-					SurfaceData const& surface;
-				} const hitInfo{
-					hitPoint,
-					GetNormalized(GetNormal(hitObject, hitPoint, t, ray.direction)),
-					GetNormalized(ray.direction),
-					GetSurfaceData(hitObject)
-				};
-				
+				intensity *= 0.35f; // LMBR is more sensitive to intense light. This allows for a more convincing look without changing the scene's light's values.
 
+				lightColour += lightSource.colour * (JL::LightIntensity(lightSource, squareDistance) * intensity * weight);
+			}
+			else
+			// PBR
+			{
+				lightColour +=
+					JL::GetScaled(
+						lightSource.colour * (JL::LightIntensity(lightSource, squareDistance) * JL::LMBR::LambertCosine(light, hitInfo.surfaceNormal) * weight),
+						JL::Shade_Lambert_CookTorrance(hitInfo.surfaceNormal, light, hitInfo.incommingRayDirection, hitInfo.surface->specular, Square(hitInfo.surface->roughness), hitInfo.surface->nonmetal, hitInfo.surface->colour)
+					);
+			}
+		};
 
-				// Direct lighting calculation function
+		// Light hit function: one shadow packet per light
 
-				JL::Visitor const shadeCalc{
-					[&lightColour, &hitInfo, &settings](auto const& lightSource, WorldVector const& distance)
+		JL::Visitor const lightHitFunction{
+			// Point light
+			[&occluded, &shadeCalc, &hitInfos, found] (WorldObject<PointLight> const& source, WorldValue squareRadius, ObjectHierarchy::SharedOrigin const* pShared)
+			{
+				WorldVector lights[W]{};
+				uint32_t facing{};
+				JL::simd::ForEachLane(
+					found,
+					[&](int lane)
 					{
-						const WorldValue squareDistance{ SqrMagnitude(distance) };
-						const WorldVector light = distance / sqrt(squareDistance);
-						
-						if (!settings.PBR)
-						// LMBR
-						{
-							const WorldVector reflection = Elite::Reflect(light, hitInfo.surfaceNormal);
+						lights[lane] = hitInfos[lane].position - source.position;
+						if (Dot(hitInfos[lane].surfaceNormal, lights[lane]) < 0 && SqrMagnitude(lights[lane]) <= squareRadius)
+							facing |= 1u << lane;
+					}
+				);
+				if (facing == 0)
+					return;
 
-							WorldValue intensity{};
-							intensity += hitInfo.surface.roughness * JL::LMBR::LambertCosine(light, hitInfo.surfaceNormal);
-							intensity += (1 - hitInfo.surface.roughness) * JL::LMBR::Phong(hitInfo.incommingRayDirection, reflection, 60.f);
+				const Packet lightPacket{ source.position, lights, Ray::tMin, 1.f - Ray::tMin, Mask::FromBits(facing) };
+				JL::simd::ForEachLane(
+					AndNot(lightPacket.active, occluded(lightPacket, pShared)),
+					[&](int lane) { shadeCalc(lane, source, lights[lane], 1); }
+				);
+			},
+			// Directional light
+			[&occluded, &shadeCalc, &hitInfos, found](WorldObject<DirectionalLight> const& source)
+			{
+				WorldPoint origins[W]{};
+				uint32_t facing{};
+				JL::simd::ForEachLane(
+					found,
+					[&](int lane)
+					{
+						origins[lane] = hitInfos[lane].position;
+						if (Dot(hitInfos[lane].surfaceNormal, source.direction) > 0)
+							facing |= 1u << lane;
+					}
+				);
+				if (facing == 0)
+					return;
+
+				// Cast towards the light, the scalar version cast away from it and tested for hits behind
+				const Packet lightPacket{ origins, -source.direction, Ray::tMin, Ray::tMax, Mask::FromBits(facing) };
+				JL::simd::ForEachLane(
+					AndNot(lightPacket.active, occluded(lightPacket, nullptr)),
+					[&](int lane) { shadeCalc(lane, source, source.direction, 1); }
+				);
+			}
+		};
 
-							intensity *= 0.35f; // LMBR is more sensitive to intense light. This allows for a more convincing look without changing the scene's light's values.
+		// Light sampling: every hit picks lightSamples lights by their importance to it, through the scene's light hierarchy.
+		// Weighted by one over the chance they were picked with, on average they add up to every light together
+
+		auto const sampleLights = [&]()
+		{
+			auto const& pointLights{ scene.lights.template Get<WorldObject<PointLight>>() };
+			auto const& directionalLights{ scene.lights.template Get<WorldObject<DirectionalLight>>() };
+			const WorldValue samples{ static_cast<WorldValue>(settings.lightSamples) };
 
-							lightColour += lightSource.colour * (JL::LightIntensity(lightSource, squareDistance) * intensity);
+			for (size_t s{}; s < settings.lightSamples; ++s)
+			{
+				LightHierarchy::Sample picks[W]{};
+				WorldPoint origins[W]{};
+				WorldVector toLights[W]{};
+				float limits[W]{};
+				uint32_t facing{};
+				JL::simd::ForEachLane(
+					found,
+					[&](int lane)
+					{
+						HitInfo const& hitInfo{ hitInfos[lane] };
+						LightHierarchy::Sample& pick{ picks[lane] };
+						const WorldValue u{ Random(pixels[lane].x, pixels[lane].y, static_cast<uint32_t>(sample), static_cast<uint32_t>(s)) };
+						if (!scene.lightHierarchy.Pick(pick, hitInfo.position, hitInfo.surfaceNormal, u))
+							return;
+
+						origins[lane] = hitInfo.position;
+						if (pick.distant)
+						{
+							toLights[lane] = -directionalLights[pick.light].direction;
+							limits[lane] = Ray::tMax;
 						}
 						else
-						// PBR
 						{
-							lightColour +=
-								JL::GetScaled(
-									lightSource.colour * (JL::LightIntensity(lightSource, squareDistance) * JL::LMBR::LambertCosine(light, hitInfo.surfaceNormal)),
-									JL::Shade_Lambert_CookTorrance(hitInfo.surfaceNormal, light, hitInfo.incommingRayDirection, hitInfo.surface.specular, Square(hitInfo.surface.roughness), hitInfo.surface.nonmetal, hitInfo.surface.colour)
-								);
+							toLights[lane] = pointLights[pick.light].position - hitInfo.position;
+							limits[lane] = 1.f - Ray::tMin;
 						}
+						if (Dot(hitInfo.surfaceNormal, toLights[lane]) > 0)
+							facing |= 1u << lane;
 					}
-				};
+				);
+				if (facing == 0)
+					continue;
 
-				// Light hit function
+				// Every lane towards its own light
+				Mask lit{ Mask::FromBits(facing) };
+				if constexpr (hardShadows)
+				{
+					Packet lightPacket{ origins, toLights, Ray::tMin, Ray::tMax, lit };
+					lightPacket.tMax = Lanes::Load(limits);
+					lit = AndNot(lit, occluded(lightPacket, nullptr));
+				}
 
-				JL::Visitor const lightHitFunction{
-					// Point light
-					[&scene, &shadeCalc, &hitInfo, &ray] (WorldObject<PointLight> const& source)
+				JL::simd::ForEachLane(
+					lit,
+					[&](int lane)
 					{
-						const Ray lightRay{ source.position, hitInfo.position };
-						if (Dot(hitInfo.surfaceNormal, lightRay.direction) < 0)
+						LightHierarchy::Sample const& pick{ picks[lane] };
+						const WorldValue weight{ 1 / (pick.pdf * samples) };
+						if (pick.distant)
+							shadeCalc(lane, directionalLights[pick.light], directionalLights[pick.light].direction, weight);
+						else
+							shadeCalc(lane, pointLights[pick.light], -toLights[lane], weight);
+					}
+				);
+			}
+		};
+
+		if (settings.lightSamples != 0)
+			sampleLights();
+		else if constexpr (hardShadows)
+			forEachLight(lightHitFunction);
+		else
+		{
+			JL::simd::ForEachLane(
+				found,
+				[&](int lane)
+				{
+					// Light No Shadow function
+
+					JL::Visitor const lightNoHitFunction{
+						// Point light
+						[&shadeCalc, &hitInfos, lane](WorldObject<PointLight> const& source, WorldValue squareRadius, ObjectHierarchy::SharedOrigin const*)
 						{
-							const bool hit{ scene.objects.AnyOf(
-								[&lightRay](auto const& object) -> bool
-								{
-									if (object.cullmode == JL::CullMode::none)
-										return false;
-									Intersection t{};
-									return JL::Intersect<false>(t, lightRay, object, JL::CullMode::both) && t < 1.f - Ray::tMin;
-								}
-							) };
-							if (!hit)
-								shadeCalc(source, lightRay.direction);
-						}
-					},
-					// Directional light
-					[&scene, &shadeCalc, &hitInfo](WorldObject<DirectionalLight> const& source)
-					{
-						const Ray lightRay{ hitInfo.position, source.direction }; // We cast away from the light, but test for hits behind
-						if (Dot(hitInfo.surfaceNormal, lightRay.direction) > 0)
+							WorldVector const light{ hitInfos[lane].position - source.position };
+							if (Dot(hitInfos[lane].surfaceNormal, light) < 0 && SqrMagnitude(light) <= squareRadius)
+								shadeCalc(lane, source, light, 1);
+						},
+						// Directional light
+						[&shadeCalc, &hitInfos, lane](WorldObject<DirectionalLight> const& source)
 						{
-							const bool hit{ scene.objects.AnyOf(
-								[&lightRay](auto const& object) -> bool
-								{
-									if (object.cullmode == JL::CullMode::none)
-										return false;
-									return JL::Intersect<true>(lightRay, object, JL::CullMode::both);
-								}
-							) };
-							if (!hit)
-								shadeCalc(source, source.direction);
-						}
-					}
-				};
+							WorldVector const& light{ source.direction };
+							if (Dot(hitInfos[lane].surfaceNormal, light) < 0)
+								shadeCalc(lane, source, light, 1);
+						},
+					};
 
-				// Light No Shadow function
+					forEachLight(lightNoHitFunction);
+				}
+			);
+		}
 
-				JL::Visitor const lightNoHitFunction{
-					// Point light
-					[&shadeCalc, &hitInfo](WorldObject<PointLight> const& source)
-					{
-						WorldVector const light{ hitInfo.position - source.position  };
-						if (Dot(hitInfo.surfaceNormal, light) < 0)
-							shadeCalc(source, light);
-					},
-					// Directional light
-					[&shadeCalc, &hitInfo](WorldObject<DirectionalLight> const& source)
-					{
-						WorldVector const& light{ source.direction  };
-						if (Dot(hitInfo.surfaceNormal, light) < 0)
-							shadeCalc(source, light);
-					},
-				};
-
-				if (settings.hardShadows)
-					scene.lights.ForEach(lightHitFunction);
-				else
-					scene.lights.ForEach(lightNoHitFunction);
-				
-				// Setting final pixel colour
+		// Setting final pixel colours
+
+		JL::simd::ForEachLane(
+			packet.active,
+			[&](int lane)
+			{
+				RasterPoint const& point{ pixels[lane] };
+
+				if (!((found.Bits() >> lane) & 1u))
+				{
+					target.pixels[point.x + (point.y * target.width)] = defaultColour;
+					return;
+				}
+
+				HitInfo const& hitInfo{ hitInfos[lane] };
+				Colour& lightColour{ lightColours[lane] };
+
+				if (hitInfo.surface->nonmetal)
+					JL::Scale(lightColour, hitInfo.surface->colour * hitInfo.surface->reflectance);
 
-				if (hitInfo.surface.nonmetal)
-					JL::Scale(lightColour, hitInfo.surface.colour * hitInfo.surface.reflectance);
-				
 				ColourValue const max = std::max(lightColour.r, std::max(lightColour.g, lightColour.b));
-				
-				if (!settings.maxToAll) // constexpr (MAX_TO_ONE)
+
+				if constexpr (!maxToAll)
 				{
 					if (max > 1)
 						lightColour /= max;
@@ -284,38 +1059,18 @@ void Elite::Renderer::Render(const Camera& camera, Scene const& scene, RenderSet
 						high = max;
 				}
 
-				m_PixelColourVector[point.x + (point.y * m_Width)] = lightColour;
+				target.pixels[point.x + (point.y * target.width)] = lightColour;
 			}
-			else
-				m_PixelColourVector[point.x + (point.y * m_Width)] = defaultColour;
+		);
 
-		}
 	}
 
-	// Normalize all colour values
-
-	ColourValue factor{ 255.f / (settings.maxToAll ? high : 1) }; //JL::Conditional<MAX_TO_ONE>(1, high) };
-	
-	std::transform(
-		begin(m_PixelColourVector), end(m_PixelColourVector), m_pBackBufferPixels,
-		[factor, format = m_pBackBuffer->format] (Colour const& colour)
-		{
-			return SDL_MapRGB(
-				format,
-				static_cast<PixelSubValue>(colour.r * factor),
-				static_cast<PixelSubValue>(colour.g * factor),
-				static_cast<PixelSubValue>(colour.b * factor)
-			);
-		}
-	);
-
-
-	SDL_UnlockSurface(m_pBackBuffer);
-	SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
-	SDL_UpdateWindowSurface(m_pWindow);
+	return high;
 }
 
 bool Elite::Renderer::SaveBackbufferToImage() const
 {
-	return SDL_SaveBMP(m_pBackBuffer, "BackbufferRender.bmp");
+	if (!m_pFrontBuffer)
+		return true; // same as SDL_SaveBMP: non zero on failure
+	return SDL_SaveBMP(m_pFrontBuffer, "BackbufferRender.bmp");
 }
\ No newline at end of file
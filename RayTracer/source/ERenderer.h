@@ -9,10 +9,13 @@
 #define	ELITE_RAYTRACING_RENDERER
 
 #include "RenderUtils.h"
+#include "JL/JLThreadPool.h"
 #include <vector>
+#include <utility>
 
 struct SDL_Window;
 struct SDL_Surface;
+struct SDL_PixelFormat;
 
 namespace Elite
 {
@@ -25,23 +28,171 @@ namespace Elite
 	public:
 
 		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+		Renderer(RasterValue width, RasterValue height); // headless: only traces into the framebuffer
+		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
+		// Trace and present to the window
 		void Render(const Camera& camera, Scene const& scene, RenderSettings const& settings);
+		// Trace into the framebuffer only, returns the highest colour value when settings.maxToAll
+		ColourValue Trace(const Camera& camera, Scene const& scene, RenderSettings const& settings);
+		// Next progressive pass into the framebuffer: coarse previews at 1/8, 1/4 and 1/2 resolution first,
+		// then jittered full resolution samples. Every tile averages its samples until something changes in it
+		ColourValue TraceProgressive(const Camera& camera, Scene const& scene, RenderSettings const& settings);
+		// Starts the progressive frame over, with preview on camera motion. Without preview the next pass is a full resolution sample
+		void Restart(bool preview = true) noexcept;
+		// Marks the tiles a change within bounds can affect: where bounds is seen and, with hard shadows, where it can cast shadows.
+		// Call with the bounds of a moved object before and after moving it. Another camera, scene or setting retraces every tile by itself
+		void Invalidate(Box const& bounds);
+		size_t GetSampleCount() const noexcept { return m_SampleCount; }
+
+		// Counts of the last Trace or TraceProgressive call: primary rays, and the hierarchy nodes visited for them and their shadow rays, once per packet.
+		// Misses are the visits a direct mapped 32 KiB cache per thread would not have held, see JL::TraversalCounter
+		struct TraversalStats
+		{
+			size_t rays;
+			size_t visits;
+			size_t misses;
+		};
+
+		// Counting costs a little per node visited, it is off by default
+		void SetTraversalCounting(bool counting);
+		TraversalStats GetTraversalStats() const;
 		bool SaveBackbufferToImage() const;
 
+		std::vector<Colour> const& GetFramebuffer() const noexcept { return m_PixelColourVector; }
+		RasterValue GetWidth() const noexcept { return m_Width; }
+		RasterValue GetHeight() const noexcept { return m_Height; }
+
+		struct FrameSetup
+		{
+			WorldPoint origin;
+			WorldVector direction;  // through pixel (0, 0)
+			WorldVector xIncrement; // per pixel
+			WorldVector yIncrement; // per pixel
+		};
+
+		// pixel block traced as one packet: 2x2, 4x2 or 4x4
+		template<int W>
+		static constexpr RasterValue BLOCK_WIDTH = W == 4 ? 2 : 4;
+		template<int W>
+		static constexpr RasterValue BLOCK_HEIGHT = W / BLOCK_WIDTH<W>;
+
+		// Camera ray setup, shared by every pixel of a width x height frame
+		static FrameSetup SetupFrame(const Camera& camera, RasterValue width, RasterValue height);
+		// Primary rays of the pixel block at block, pixels at or past to are left inactive
+		template<int W>
+		static RayPacket<W> PrimaryPacket(FrameSetup const& frame, RasterPoint const& block, RasterPoint const& to, RasterPoint (&pixels)[W], WorldVector (&directions)[W]);
+
 	private:
 
+		static constexpr RasterValue TILE_SIZE = 16;
+		static constexpr RasterValue PREVIEW_SCALE = 8;
+
+		struct Target
+		{
+			Colour* pixels;
+			RasterValue width;
+			RasterValue height;
+		};
+
+		struct TileOrder
+		{
+			RasterValue width;
+			RasterValue height;
+			PixelOrder order;
+			std::vector<size_t> tiles;
+		};
+
+		// Point lights that can reach the visible points of every tile of the target being traced
+		struct LightLists
+		{
+			std::vector<size_t> offsets;         // tile t's lights are indices [offsets[t], offsets[t + 1])
+			std::vector<uint32_t> indices;       // into the scene's point lights
+			std::vector<WorldValue> squareRadii; // per point light, points further away are not lit by it
+		};
+
+		struct TileState
+		{
+			bool dirty;
+			size_t samples;   // progressive samples in the accumulation
+			ColourValue high; // highest colour value traced in the tile
+		};
+
+		// Pixels [from, to) of a tile of a width x height target
+		static void GetTileBounds(size_t tile, RasterValue width, RasterValue height, RasterPoint& from, RasterPoint& to);
+		// Tiles [first, last] of a width x height target that raster bounds [low, high] touch, with a pixel of margin. False when off screen
+		static bool GetTileRange(WorldValue const (&low)[2], WorldValue const (&high)[2], RasterValue width, RasterValue height, RasterPoint& first, RasterPoint& last);
+		// Influence spheres of the point lights, by settings.lightCutoff, projected to the tiles of a width x height target seen through frame
+		void BuildLightLists(FrameSetup const& frame, RasterValue width, RasterValue height, Scene const& scene, RenderSettings const& settings);
+		// Origin terms of the objects for the camera rays and, with hard shadows, for the shadow rays from every point light
+		void PrecomputeOrigins(FrameSetup const& frame, Scene const& scene, RenderSettings const& settings);
+		// Cells of a columns x rows grid in order
+		static std::vector<RasterPoint> Order(RasterValue columns, RasterValue rows, PixelOrder order);
+		// Tiles of a width x height target in order, kept for every target size asked for
+		std::vector<size_t> const& GetTileOrder(RasterValue width, RasterValue height, PixelOrder order);
+		// Offsets of the pixel blocks of a tile in order
+		template<int W>
+		static std::vector<RasterPoint> const& GetBlockOrder(PixelOrder order);
+		// Traces a tile with settings compiled in, see RenderTile
+		using TileKernel = ColourValue (Renderer::*)(size_t tile, size_t sample, RasterPoint const& from, RasterPoint const& to, FrameSetup const& frame, Target const& target, Scene const& scene, RenderSettings const& settings);
+
+		// The kernel for the packet width and settings, chosen once per frame
+		TileKernel ChooseKernel(RenderSettings const& settings) const;
+		// Kernels of packet width W for every combination of settings: PBR, hard shadows and max to all are the bits of the index
+		template<int W, int... Combinations>
+		static TileKernel GetKernel(int combination, std::integer_sequence<int, Combinations...>);
+		// sample: index of the progressive sample being traced, varies the lights picked when sampling lights
+		ColourValue TraceTile(TileKernel kernel, size_t tile, size_t worker, size_t sample, FrameSetup const& frame, Target const& target, Scene const& scene, RenderSettings const& settings);
+		// Marks the tiles the changes since last frame affect, all of them when the camera, scene or settings changed
+		void UpdateDirtyTiles(FrameSetup const& frame, Scene const& scene, RenderSettings const& settings);
+		ColourValue GetHigh() const;
+
+		// Traces blocks of W pixels as one packet, W is one of 4, 8 or 16.
+		// The settings given as template arguments are compiled in, the ones in settings are ignored
+		template<int W, bool PBR, bool hardShadows, bool maxToAll>
+		ColourValue RenderTile(size_t tile, size_t sample, RasterPoint const& from, RasterPoint const& to, FrameSetup const& frame, Target const& target, Scene const& scene, RenderSettings const& settings);
+
+		// How the framebuffer is written into the window surface, chosen once per surface format
+		struct Packer
+		{
+			uint32_t format;              // the SDL pixel format it was chosen for
+			bool direct;                  // 32 bit pixels with byte sized channels, any other format goes through SDL_MapRGB
+			bool shuffle;                 // the cpu can run the SIMD packers, otherwise pixels are packed one at a time
+			JL::simd::PixelLayout layout;
+		};
+
+		static Packer ChoosePacker(SDL_PixelFormat const* pFormat);
+		// Tone maps and packs the framebuffer into the surface, tile by tile in parallel
+		void Resolve(SDL_Surface* pSurface, ColourValue factor);
+		// Scales count colours by factor, clamps them to [0, 255] and packs them W at a time, W is one of 1, 4, 8 or 16
+		template<int W>
+		static void ResolveRow(Colour const* colours, PixelValue* pixels, RasterValue count, ColourValue factor, JL::simd::PixelLayout const& layout);
+
+		JL::ThreadPool m_ThreadPool{};
+		int m_PacketWidth = JL::simd::DetectWidth();
 		SDL_Window* m_pWindow = nullptr;
 		SDL_Surface* m_pFrontBuffer = nullptr;
-		SDL_Surface* m_pBackBuffer = nullptr;
-		PixelValue* m_pBackBufferPixels = nullptr;
+		Packer m_Packer{};
 		std::vector<Colour> m_PixelColourVector{};
+		std::vector<Colour> m_AccumulationVector{}; // sum of the progressive samples
+		std::vector<Colour> m_PreviewColourVector{};
+		size_t m_SampleCount = 0;
+		RasterValue m_PreviewScale = PREVIEW_SCALE; // preview passes left while above 1
+		std::vector<TileState> m_Tiles{};
+		std::vector<TileOrder> m_TileOrders{};
+		LightLists m_LightLists{};
+		ObjectHierarchy::SharedOrigin m_CameraOrigin{};
+		std::vector<ObjectHierarchy::SharedOrigin> m_LightOrigins{}; // per point light, empty without hard shadows
+		std::vector<JL::TraversalCounter> m_TraversalCounters{}; // per worker, empty unless counting
+		std::vector<Box> m_Changes{};
+		FrameSetup m_LastFrame{};
+		RenderSettings m_LastSettings{};
+		Scene const* m_pLastScene = nullptr;
 		RasterValue m_Width = 0;
 		RasterValue m_Height = 0;
 
@@ -0,0 +1,197 @@
+#include "ImageUtils.h"
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <string>
+
+namespace
+{
+
+	using Elite::Colour;
+	using Elite::ColourValue;
+	using Elite::RasterValue;
+	using Bytes = std::vector<uint8_t>;
+
+	uint8_t ToByte(ColourValue value, ColourValue factor)
+	{
+		return static_cast<uint8_t>(std::clamp(value * factor, 0.f, 255.f));
+	}
+
+	void PutBigEndian(Bytes& bytes, uint32_t value)
+	{
+		bytes.push_back(static_cast<uint8_t>(value >> 24));
+		bytes.push_back(static_cast<uint8_t>(value >> 16));
+		bytes.push_back(static_cast<uint8_t>(value >> 8));
+		bytes.push_back(static_cast<uint8_t>(value));
+	}
+
+	uint32_t Crc32(uint8_t const* data, size_t size, uint32_t crc = 0)
+	{
+		static const auto table = []()
+		{
+			std::vector<uint32_t> table(256);
+			for (uint32_t n{}; n < 256; ++n)
+			{
+				uint32_t c{ n };
+				for (int k{}; k < 8; ++k)
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				table[n] = c;
+			}
+			return table;
+		}();
+
+		crc = ~crc;
+		for (size_t i{}; i < size; ++i)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	uint32_t Adler32(Bytes const& data)
+	{
+		uint32_t a{ 1 }, b{ 0 };
+		for (uint8_t byte : data)
+		{
+			a = (a + byte) % 65521;
+			b = (b + a) % 65521;
+		}
+		return (b << 16) | a;
+	}
+
+	void PutChunk(Bytes& png, char const (&type)[5], Bytes const& data)
+	{
+		PutBigEndian(png, static_cast<uint32_t>(data.size()));
+		const size_t start{ png.size() };
+		png.insert(png.end(), type, type + 4);
+		png.insert(png.end(), data.begin(), data.end());
+		PutBigEndian(png, Crc32(png.data() + start, png.size() - start));
+	}
+
+	bool WriteFile(std::string_view filePath, char const* data, size_t size)
+	{
+		std::ofstream file{ std::string{ filePath }, std::ios::out | std::ios::binary };
+		file.write(data, static_cast<std::streamsize>(size));
+		return bool(file);
+	}
+
+	bool WritePPM(std::string_view filePath, std::vector<Colour> const& pixels, RasterValue width, RasterValue height, ColourValue factor)
+	{
+		const std::string header{ "P6\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n" };
+		std::vector<char> data(header.begin(), header.end());
+		data.reserve(header.size() + width * height * 3);
+		for (Colour const& colour : pixels)
+		{
+			data.push_back(static_cast<char>(ToByte(colour.r, factor)));
+			data.push_back(static_cast<char>(ToByte(colour.g, factor)));
+			data.push_back(static_cast<char>(ToByte(colour.b, factor)));
+		}
+		return WriteFile(filePath, data.data(), data.size());
+	}
+
+	bool WritePNG(std::string_view filePath, std::vector<Colour> const& pixels, RasterValue width, RasterValue height, ColourValue factor)
+	{
+		// Raw scanlines, each preceded by filter type 0 (none)
+		Bytes raw{};
+		raw.reserve(height * (width * 3 + 1));
+		for (RasterValue y{}; y < height; ++y)
+		{
+			raw.push_back(0);
+			for (RasterValue x{}; x < width; ++x)
+			{
+				Colour const& colour{ pixels[x + y * width] };
+				raw.push_back(ToByte(colour.r, factor));
+				raw.push_back(ToByte(colour.g, factor));
+				raw.push_back(ToByte(colour.b, factor));
+			}
+		}
+
+		// zlib stream of stored (uncompressed) deflate blocks
+		constexpr size_t BLOCK{ 65535 };
+		Bytes zlib{ 0x78, 0x01 };
+		zlib.reserve(raw.size() + raw.size() / BLOCK * 5 + 16);
+		size_t offset{};
+		do
+		{
+			const size_t size{ std::min(BLOCK, raw.size() - offset) };
+			const bool last{ offset + size == raw.size() };
+			zlib.push_back(last ? 1 : 0);
+			zlib.push_back(static_cast<uint8_t>(size));
+			zlib.push_back(static_cast<uint8_t>(size >> 8));
+			zlib.push_back(static_cast<uint8_t>(~size));
+			zlib.push_back(static_cast<uint8_t>(~size >> 8));
+			zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+			offset += size;
+		} while (offset < raw.size());
+		PutBigEndian(zlib, Adler32(raw));
+
+		Bytes header{};
+		PutBigEndian(header, static_cast<uint32_t>(width));
+		PutBigEndian(header, static_cast<uint32_t>(height));
+		header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8 bit, rgb, deflate, adaptive filtering, no interlace
+
+		Bytes png{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		PutChunk(png, "IHDR", header);
+		PutChunk(png, "IDAT", zlib);
+		PutChunk(png, "IEND", {});
+
+		return WriteFile(filePath, reinterpret_cast<char const*>(png.data()), png.size());
+	}
+
+	bool WritePFM(std::string_view filePath, std::vector<Colour> const& pixels, RasterValue width, RasterValue height)
+	{
+		// negative scale: little endian. Rows are stored bottom to top
+		const std::string header{ "PF\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n-1.0\n" };
+		std::vector<char> data(header.begin(), header.end());
+		data.resize(header.size() + width * height * 3 * sizeof(float));
+		char* out{ data.data() + header.size() };
+		for (RasterValue y{ height }; y-- > 0;)
+		{
+			for (RasterValue x{}; x < width; ++x)
+			{
+				Colour const& colour{ pixels[x + y * width] };
+				const float values[3]{ colour.r, colour.g, colour.b };
+				std::memcpy(out, values, sizeof(values));
+				out += sizeof(values);
+			}
+		}
+		return WriteFile(filePath, data.data(), data.size());
+	}
+
+}
+
+Elite::ImageFormat Elite::GetImageFormat(std::string_view filePath)
+{
+	const size_t dot{ filePath.find_last_of('.') };
+	if (dot == std::string_view::npos)
+		return ImageFormat::PPM;
+
+	std::string extension{ filePath.substr(dot + 1) };
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+
+	if (extension == "png")
+		return ImageFormat::PNG;
+	if (extension == "pfm")
+		return ImageFormat::PFM;
+	return ImageFormat::PPM;
+}
+
+bool Elite::WriteImage(std::string_view filePath, std::vector<Colour> const& pixels, RasterValue width, RasterValue height, ColourValue factor)
+{
+	return WriteImage(filePath, GetImageFormat(filePath), pixels, width, height, factor);
+}
+
+bool Elite::WriteImage(std::string_view filePath, ImageFormat format, std::vector<Colour> const& pixels, RasterValue width, RasterValue height, ColourValue factor)
+{
+	if (pixels.size() != width * height)
+		return false;
+
+	switch (format)
+	{
+	case ImageFormat::PNG:
+		return WritePNG(filePath, pixels, width, height, factor);
+	case ImageFormat::PFM:
+		return WritePFM(filePath, pixels, width, height);
+	default:
+		return WritePPM(filePath, pixels, width, height, factor);
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include "RenderUtils.h"
+
+namespace Elite
+{
+
+	enum class ImageFormat
+	{
+		PPM, // binary 8 bit rgb
+		PNG, // 8 bit rgb, uncompressed deflate
+		PFM, // 32 bit float rgb, unscaled
+	};
+
+	// From the file extension, PPM when unknown
+	ImageFormat GetImageFormat(std::string_view filePath);
+
+	// pixels are row major, top row first.
+	// 8 bit formats scale the colours by factor and clamp them, PFM writes the colours as they are.
+	bool WriteImage(std::string_view filePath, std::vector<Colour> const& pixels, RasterValue width, RasterValue height, ColourValue factor = 1);
+	bool WriteImage(std::string_view filePath, ImageFormat format, std::vector<Colour> const& pixels, RasterValue width, RasterValue height, ColourValue factor = 1);
+
+}
@@ -2,13 +2,25 @@
 
 #include "JLBaseIncludes.h"
 #include "JLGeometry.h"
+#include "JLBox.h"
+#include "JLBVH.h"
+#include "JLWideBVH.h"
+#include "JLLazyBVH.h"
+#include "JLSpaceFillingCurve.h"
 #include "JLCalculus.h"
+#include "JLSimd.h"
+#include "JLRayPacket.h"
 #include "JLCamera.h"
 #include "JLVectorTuple.h"
 #include "JLVisitor.h"
 #include "JLColoured.h"
 #include "JLLighting.h"
+#include "JLLightHierarchy.h"
 #include "JLReadFromIstream.h"
 #include "JLMesh.h"
+#include "JLMeshInstance.h"
+#include "JLSphereSet.h"
+#include "JLGrid.h"
 #include "JLOBJ.h"
-#include "JLMeshConstruct.h"
\ No newline at end of file
+#include "JLMeshConstruct.h"
+#include "JLObjectHierarchy.h"
\ No newline at end of file
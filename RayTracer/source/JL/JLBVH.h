@@ -0,0 +1,564 @@
+// BVH.h - Bounding volume hierarchy built using a binned surface area heuristic.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include "JLBaseIncludes.h"
+#include "JLBox.h"
+#include "JLLine.h"
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <thread>
+
+namespace JL
+{
+
+	// Counts the rays traced and the hierarchy nodes traversals visit on a thread while attached to it, to compare how well
+	// an order of rays reuses nodes. Misses are the visits a direct mapped cache of CACHE_LINES lines would not have held.
+	class TraversalCounter
+	{
+	public:
+
+		static constexpr size_t LINE_SIZE = 64;
+		static constexpr size_t CACHE_LINES = 512; // 32 KiB, a typical level 1 data cache
+
+		// Attaches the counter to the calling thread for as long as it lives, nullptr attaches none
+		class Scope
+		{
+		public:
+
+			explicit Scope(TraversalCounter* pCounter) noexcept
+				: m_pPrevious{ Current() }
+			{
+				Current() = pCounter;
+			}
+
+			~Scope()
+			{
+				Current() = m_pPrevious;
+			}
+
+			Scope(Scope const&) = delete;
+			Scope& operator = (Scope const&) = delete;
+
+		private:
+
+			TraversalCounter* m_pPrevious;
+
+		};
+
+		// The counter attached to the calling thread, if any
+		static TraversalCounter*& Current() noexcept
+		{
+			thread_local TraversalCounter* pCurrent{ nullptr };
+			return pCurrent;
+		}
+
+		static void CountRays(size_t count) noexcept
+		{
+			if (TraversalCounter* const pCounter{ Current() })
+				pCounter->m_Rays += count;
+		}
+
+		static void CountVisit(void const* pNode) noexcept
+		{
+			if (TraversalCounter* const pCounter{ Current() })
+				pCounter->Visit(reinterpret_cast<uintptr_t>(pNode) / LINE_SIZE);
+		}
+
+		size_t GetRays() const noexcept { return m_Rays; }
+		size_t GetVisits() const noexcept { return m_Visits; }
+		size_t GetMisses() const noexcept { return m_Misses; }
+
+		void Reset() noexcept
+		{
+			*this = TraversalCounter{};
+		}
+
+	private:
+
+		size_t m_Rays{};
+		size_t m_Visits{};
+		size_t m_Misses{};
+		uintptr_t m_Lines[CACHE_LINES]{};
+
+		void Visit(uintptr_t line) noexcept
+		{
+			++m_Visits;
+			uintptr_t& cached{ m_Lines[line % CACHE_LINES] };
+			if (cached != line)
+			{
+				cached = line;
+				++m_Misses;
+			}
+		}
+
+	};
+
+	// The hierarchy only knows about primitive bounds and indices.
+	// Whoever owns the primitives supplies the bounds to build from,
+	// and a callable to intersect a single primitive during traversal.
+
+	template<int N, typename T>
+	class BVH
+	{
+	public:
+
+		using Value = T;
+		using Box = Box<N, T>;
+		using Index = uint32_t;
+
+		static constexpr Index BINS = 16;
+		static constexpr Index MAX_LEAF_SIZE = 4;
+		static constexpr Value TRAVERSAL_COST = static_cast<Value>(1);
+		static constexpr Value INTERSECTION_COST = static_cast<Value>(1);
+		static constexpr size_t STACK_SIZE = 64;
+		static constexpr size_t PARALLEL_REFIT_NODES = 1 << 14; // smaller trees refit on the calling thread
+
+		struct Node
+		{
+			Box bounds;
+			Index offset; // interior: index of the right child (left child follows its parent). leaf: first primitive index
+			Index count;  // 0 for interior nodes
+
+			bool IsLeaf() const noexcept
+			{
+				return count != 0;
+			}
+		};
+
+		// A split of a node's primitives: the ones whose centroid falls in bin or below along axis go left
+		struct Plane
+		{
+			int axis;
+			Index bin;
+			T low;
+			T scale; // bins per unit along axis
+
+			bool IsLeft(Box const& box) const noexcept
+			{
+				return std::min(BINS - 1, static_cast<Index>((box.Centroid(axis) - low) * scale)) <= bin;
+			}
+		};
+
+		// The cheapest binned split of the count primitives at indices by the surface area heuristic, over all axes.
+		// nodeBounds and centroidBounds are the bounds of those primitives and of their centroids.
+		// Returns false when they are cheaper as a single leaf, or cannot be split at all because their centroids coincide
+		static bool FindPlane(Plane& result, std::vector<Box> const& bounds, Index const* indices, Index count, Box const& nodeBounds, Box const& centroidBounds)
+		{
+			const T leafCost{ INTERSECTION_COST * static_cast<T>(count) };
+			T bestCost{ std::numeric_limits<T>::max() };
+			bool found{ false };
+
+			for (int axis{}; axis < N; ++axis)
+			{
+				const T low{ centroidBounds.min.data[axis] };
+				const T extent{ centroidBounds.max.data[axis] - low };
+				if (extent <= static_cast<T>(0))
+					continue;
+				const Plane plane{ axis, 0, low, static_cast<T>(BINS) / extent };
+
+				Bin bins[BINS]{};
+				for (Index i{}; i < count; ++i)
+				{
+					Box const& box{ bounds[indices[i]] };
+					const Index bin{ std::min(BINS - 1, static_cast<Index>((box.Centroid(axis) - low) * plane.scale)) };
+					++bins[bin].count;
+					bins[bin].bounds.Grow(box);
+				}
+
+				// sweep from the right to get the cost of every right side
+				T rightArea[BINS - 1]{};
+				Index rightCount[BINS - 1]{};
+				Box right{};
+				Index rightSum{};
+				for (Index bin{ BINS - 1 }; bin > 0; --bin)
+				{
+					right.Grow(bins[bin].bounds);
+					rightSum += bins[bin].count;
+					rightArea[bin - 1] = right.HalfArea();
+					rightCount[bin - 1] = rightSum;
+				}
+
+				Box left{};
+				Index leftSum{};
+				for (Index bin{}; bin < BINS - 1; ++bin)
+				{
+					left.Grow(bins[bin].bounds);
+					leftSum += bins[bin].count;
+					if (leftSum == 0 || rightCount[bin] == 0)
+						continue;
+					const T cost{ left.HalfArea() * leftSum + rightArea[bin] * rightCount[bin] };
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						result = plane;
+						result.bin = bin;
+						found = true;
+					}
+				}
+			}
+
+			if (!found)
+				return false; // all centroids coincide
+
+			const T splitCost{ TRAVERSAL_COST + INTERSECTION_COST * bestCost / nodeBounds.HalfArea() };
+			return splitCost < leafCost || count > MAX_LEAF_SIZE;
+		}
+
+		// Moves the primitives left of plane to the front of the count at indices, returns how many there are
+		static Index Partition(Plane const& plane, std::vector<Box> const& bounds, Index* indices, Index count)
+		{
+			Index* const middle{ std::partition(indices, indices + count, [&bounds, &plane](Index index) { return plane.IsLeft(bounds[index]); }) };
+			return static_cast<Index>(middle - indices);
+		}
+
+		BVH() = default;
+
+		void Build(std::vector<Box> const& bounds)
+		{
+			m_Nodes.clear();
+			m_Indices.resize(bounds.size());
+			std::iota(m_Indices.begin(), m_Indices.end(), Index{});
+
+			if (bounds.empty())
+				return;
+
+			m_Nodes.reserve(bounds.size() * 2);
+			m_Nodes.emplace_back();
+			Split(bounds, 0, 0, static_cast<Index>(bounds.size()), 0);
+			m_BuildCost = m_Cost = Cost();
+		}
+
+		// Takes nodes and indices as returned by GetNodes and GetIndices of a hierarchy built before, over primitiveCount primitives.
+		// Returns false, leaving the hierarchy empty, when they do not form a valid tree.
+		bool Restore(std::vector<Node> nodes, std::vector<Index> indices, Index primitiveCount)
+		{
+			m_Nodes = std::move(nodes);
+			m_Indices = std::move(indices);
+
+			bool valid{ m_Indices.size() == primitiveCount && m_Nodes.empty() == m_Indices.empty() };
+			for (Index index : m_Indices)
+				valid &= index < primitiveCount;
+			// Traversal keeps one far child on the stack per level, deeper trees would overflow it
+			std::vector<size_t> depths(m_Nodes.size());
+			for (Index index{}; valid && index < m_Nodes.size(); ++index)
+			{
+				Node const& node{ m_Nodes[index] };
+				valid = node.IsLeaf()
+					? node.offset <= m_Indices.size() && node.count <= m_Indices.size() - node.offset
+					: node.offset > index + 1 && node.offset < m_Nodes.size() && depths[index] + 1 < STACK_SIZE; // children come after their parent
+				if (valid && !node.IsLeaf())
+				{
+					depths[index + 1] = std::max(depths[index + 1], depths[index] + 1);
+					depths[node.offset] = std::max(depths[node.offset], depths[index] + 1);
+				}
+			}
+
+			if (!valid)
+			{
+				Clear();
+				return false;
+			}
+			m_BuildCost = m_Cost = Cost();
+			return true;
+		}
+
+		// Updates the node bounds to primitives that moved, keeping the tree as it is.
+		// bounds are indexed by primitive, like for Build. The primitive count has to be the same.
+		// Returns how much worse the tree got since it was built: the ratio of its current SAH cost to its cost when built.
+		T Refit(std::vector<Box> const& bounds)
+		{
+			if (m_Nodes.empty())
+				return static_cast<T>(1);
+
+			// Every subtree is a contiguous range of nodes, children after their parents.
+			// Large trees refit their top level subtrees concurrently, and the few nodes above those after.
+			std::vector<Index> top{};
+			std::vector<Index> subtrees{ 0 };
+			if (m_Nodes.size() >= PARALLEL_REFIT_NODES)
+			{
+				const size_t workers{ std::max(1u, std::thread::hardware_concurrency()) };
+				while (subtrees.size() < workers)
+				{
+					std::vector<Index> next{};
+					for (Index index : subtrees)
+					{
+						if (m_Nodes[index].IsLeaf())
+							next.push_back(index);
+						else
+						{
+							top.push_back(index);
+							next.push_back(index + 1);
+							next.push_back(m_Nodes[index].offset);
+						}
+					}
+					if (next.size() == subtrees.size())
+						break;
+					subtrees = std::move(next);
+				}
+			}
+
+			if (subtrees.size() == 1)
+				RefitRange(bounds, subtrees.front(), SubtreeEnd(subtrees.front()));
+			else
+			{
+				std::vector<std::future<void>> jobs{};
+				jobs.reserve(subtrees.size());
+				for (Index index : subtrees)
+					jobs.push_back(std::async(std::launch::async, [this, &bounds, index]() { RefitRange(bounds, index, SubtreeEnd(index)); }));
+				for (auto& job : jobs)
+					job.get();
+			}
+
+			for (auto index{ top.rbegin() }; index != top.rend(); ++index)
+				RefitNode(bounds, *index);
+
+			m_Cost = Cost();
+			return GetDegradation();
+		}
+
+		// Expected cost of a ray through the root: every node's traversal or intersection cost weighed by the chance
+		// a ray through the root also passes through it, the surface area heuristic.
+		T Cost() const noexcept
+		{
+			if (m_Nodes.empty())
+				return static_cast<T>(0);
+
+			const T rootArea{ m_Nodes.front().bounds.HalfArea() };
+			if (rootArea <= static_cast<T>(0))
+				return INTERSECTION_COST * static_cast<T>(m_Indices.size());
+
+			T cost{};
+			for (Node const& node : m_Nodes)
+				cost += node.bounds.HalfArea() * (node.IsLeaf() ? INTERSECTION_COST * static_cast<T>(node.count) : TRAVERSAL_COST);
+			return cost / rootArea;
+		}
+
+		// Ratio of the cost after the last refit to the cost when built, 1 for a freshly built tree
+		T GetDegradation() const noexcept
+		{
+			return m_BuildCost > static_cast<T>(0) ? m_Cost / m_BuildCost : static_cast<T>(1);
+		}
+
+		void Clear() noexcept
+		{
+			m_Nodes.clear();
+			m_Indices.clear();
+			m_BuildCost = m_Cost = static_cast<T>(0);
+		}
+
+		bool IsEmpty() const noexcept
+		{
+			return m_Nodes.empty();
+		}
+
+		Box const& GetBounds() const noexcept
+		{
+			return m_Nodes.front().bounds;
+		}
+
+		std::vector<Node> const& GetNodes() const noexcept
+		{
+			return m_Nodes;
+		}
+
+		std::vector<Index> const& GetIndices() const noexcept
+		{
+			return m_Indices;
+		}
+
+		void Translate(Vector<N, T> const& translation) noexcept
+		{
+			for (Node& node : m_Nodes)
+				node.bounds.Translate(translation);
+		}
+
+		// Visits nodes front to back.
+		// hit(Index primitive, T const& tMin, T& tMax) -> bool must only report hits within [tMin, tMax) and shrink tMax to them.
+		// With anyHit, traversal stops at the first reported hit.
+		template<bool anyHit = false, typename Hit>
+		bool Traverse(Line<N, T> const& line, T const& tMin, T tMax, Hit&& hit) const
+		{
+			if (m_Nodes.empty())
+				return false;
+
+			const Vector<N, T> inverse{ GetInverse(line.direction) };
+
+			T entry{};
+			if (!Intersect(entry, line.origin, inverse, m_Nodes.front().bounds, tMin, tMax))
+				return false;
+
+			struct Entry
+			{
+				Index node;
+				T t;
+			} stack[STACK_SIZE];
+			size_t size{};
+
+			bool found{ false };
+			Index current{ 0 };
+
+			while (true)
+			{
+				Node const& node{ m_Nodes[current] };
+				TraversalCounter::CountVisit(&node);
+				if (node.IsLeaf())
+				{
+					for (Index i{ node.offset }; i < node.offset + node.count; ++i)
+					{
+						if (hit(m_Indices[i], tMin, tMax))
+						{
+							found = true;
+							if constexpr (anyHit)
+								return true;
+						}
+					}
+				}
+				else
+				{
+					Index near{ current + 1 };
+					Index far{ node.offset };
+					T nearT{}, farT{};
+					const bool nearHit{ Intersect(nearT, line.origin, inverse, m_Nodes[near].bounds, tMin, tMax) };
+					const bool farHit{ Intersect(farT, line.origin, inverse, m_Nodes[far].bounds, tMin, tMax) };
+
+					if (nearHit && farHit)
+					{
+						if (farT < nearT)
+						{
+							std::swap(near, far);
+							std::swap(nearT, farT);
+						}
+						stack[size++] = { far, farT };
+						current = near;
+						continue;
+					}
+					else if (nearHit)
+					{
+						current = near;
+						continue;
+					}
+					else if (farHit)
+					{
+						current = far;
+						continue;
+					}
+				}
+
+				// pop the next node that can still hold a closer hit
+				while (size != 0 && stack[size - 1].t > tMax)
+					--size;
+				if (size == 0)
+					break;
+				current = stack[--size].node;
+			}
+
+			return found;
+		}
+
+	private:
+
+		std::vector<Node> m_Nodes;
+		std::vector<Index> m_Indices;
+		T m_BuildCost{};
+		T m_Cost{};
+
+		struct Bin
+		{
+			Box bounds;
+			Index count = 0;
+		};
+
+		// One past the last node of the subtree: the last node of the rightmost path down
+		Index SubtreeEnd(Index index) const noexcept
+		{
+			while (!m_Nodes[index].IsLeaf())
+				index = m_Nodes[index].offset;
+			return index + 1;
+		}
+
+		void RefitNode(std::vector<Box> const& bounds, Index index) noexcept
+		{
+			Node& node{ m_Nodes[index] };
+			node.bounds = Box{};
+			if (node.IsLeaf())
+			{
+				for (Index i{ node.offset }; i < node.offset + node.count; ++i)
+					node.bounds.Grow(bounds[m_Indices[i]]);
+			}
+			else
+				node.bounds.Grow(m_Nodes[index + 1].bounds).Grow(m_Nodes[node.offset].bounds);
+		}
+
+		// Bottom up over [first, last): children always come after their parent
+		void RefitRange(std::vector<Box> const& bounds, Index first, Index last) noexcept
+		{
+			for (Index index{ last }; index-- > first;)
+				RefitNode(bounds, index);
+		}
+
+		void Split(std::vector<Box> const& bounds, Index nodeIndex, Index first, Index count, size_t depth)
+		{
+			Box nodeBounds{};
+			Box centroidBounds{};
+			for (Index i{ first }; i < first + count; ++i)
+			{
+				Box const& box{ bounds[m_Indices[i]] };
+				nodeBounds.Grow(box);
+				centroidBounds.Grow(box.Centroid());
+			}
+			m_Nodes[nodeIndex].bounds = nodeBounds;
+
+			auto makeLeaf = [this, nodeIndex, first, count]()
+			{
+				m_Nodes[nodeIndex].offset = first;
+				m_Nodes[nodeIndex].count = count;
+			};
+
+			if (count <= 1 || depth + 1 >= STACK_SIZE) // traversal never needs more stack than the tree is deep
+				return makeLeaf();
+
+			Plane plane{};
+			if (!FindPlane(plane, bounds, m_Indices.data() + first, count, nodeBounds, centroidBounds))
+				return makeLeaf();
+			const Index leftCount{ Partition(plane, bounds, m_Indices.data() + first, count) };
+
+			// depth first layout: left child directly follows its parent
+
+			const Index leftIndex{ static_cast<Index>(m_Nodes.size()) };
+			m_Nodes.emplace_back();
+			Split(bounds, leftIndex, first, leftCount, depth + 1);
+
+			const Index rightIndex{ static_cast<Index>(m_Nodes.size()) };
+			m_Nodes.emplace_back();
+			Split(bounds, rightIndex, first + leftCount, count - leftCount, depth + 1);
+
+			m_Nodes[nodeIndex].offset = rightIndex;
+			m_Nodes[nodeIndex].count = 0;
+		}
+
+	};
+
+}
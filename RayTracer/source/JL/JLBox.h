@@ -0,0 +1,157 @@
+// Box.h - Axis aligned bounding box.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include "JLBaseIncludes.h"
+#include <algorithm>
+#include <limits>
+
+namespace JL
+{
+
+	template<int N, typename T>
+	struct Box
+	{
+		using Value = T;
+		using Point = Point<N, T>;
+		using Vector = Vector<N, T>;
+
+		Point min;
+		Point max;
+
+		// Empty box: growing it by anything results in that thing's bounds
+		Box()
+		{
+			for (int i{}; i < N; ++i)
+			{
+				min.data[i] =  std::numeric_limits<T>::max();
+				max.data[i] = -std::numeric_limits<T>::max();
+			}
+		}
+
+		Box(const Point& min, const Point& max)
+			: min{ min }
+			, max{ max }
+		{}
+
+		bool IsEmpty() const noexcept
+		{
+			return min.data[0] > max.data[0];
+		}
+
+		Box& Grow(const Point& point) noexcept
+		{
+			for (int i{}; i < N; ++i)
+			{
+				min.data[i] = std::min(min.data[i], point.data[i]);
+				max.data[i] = std::max(max.data[i], point.data[i]);
+			}
+			return *this;
+		}
+
+		Box& Grow(const Box& box) noexcept
+		{
+			for (int i{}; i < N; ++i)
+			{
+				min.data[i] = std::min(min.data[i], box.min.data[i]);
+				max.data[i] = std::max(max.data[i], box.max.data[i]);
+			}
+			return *this;
+		}
+
+		Box& Translate(const Vector& translation) noexcept
+		{
+			min += translation;
+			max += translation;
+			return *this;
+		}
+
+		Vector Extent() const noexcept
+		{
+			return max - min;
+		}
+
+		Point Centroid() const noexcept
+		{
+			return min + Extent() * static_cast<T>(0.5);
+		}
+
+		T Centroid(int axis) const noexcept
+		{
+			return (min.data[axis] + max.data[axis]) * static_cast<T>(0.5);
+		}
+
+		// Half of the surface area. Only ever used relatively, for the surface area heuristic.
+		T HalfArea() const noexcept
+		{
+			if (IsEmpty())
+				return static_cast<T>(0);
+			const Vector extent{ Extent() };
+			T area{};
+			for (int i{}; i < N; ++i)
+				for (int j{ i + 1 }; j < N; ++j)
+					area += extent.data[i] * extent.data[j];
+			return area;
+		}
+
+		int LongestAxis() const noexcept
+		{
+			const Vector extent{ Extent() };
+			int axis{};
+			for (int i{ 1 }; i < N; ++i)
+				if (extent.data[i] > extent.data[axis])
+					axis = i;
+			return axis;
+		}
+
+	};
+
+	// Slab test. inverse is the componentwise inverse of the line direction.
+	// On hit, entry holds the distance at which the line enters the box (clamped to tMin).
+	template<int N, typename T>
+	bool Intersect(T& entry, const Point<N, T>& origin, const Vector<N, T>& inverse, const Box<N, T>& box, T const& tMin, T const& tMax)
+	{
+		T near{ tMin };
+		T far{ tMax };
+		for (int i{}; i < N; ++i)
+		{
+			T t0{ (box.min.data[i] - origin.data[i]) * inverse.data[i] };
+			T t1{ (box.max.data[i] - origin.data[i]) * inverse.data[i] };
+			if (t0 > t1)
+				std::swap(t0, t1);
+			near = std::max(near, t0);
+			far = std::min(far, t1);
+		}
+		entry = near;
+		return near <= far;
+	}
+
+	template<int N, typename T>
+	Vector<N, T> GetInverse(const Vector<N, T>& direction)
+	{
+		Vector<N, T> inverse{};
+		for (int i{}; i < N; ++i)
+			inverse.data[i] = static_cast<T>(1) / direction.data[i];
+		return inverse;
+	}
+
+}
@@ -22,8 +22,13 @@
 
 #pragma once
 #include "JLGeometry.h"
+#include "JLBox.h"
 #include "JLMesh.h"
+#include "JLMeshInstance.h"
+#include "JLSphereSet.h"
+#include "JLSimd.h"
 #include <algorithm>
+#include <type_traits>
 
 namespace JL
 {
@@ -125,8 +130,9 @@ namespace JL
 		}
 	}
 
+	// Moller-Trumbore on a baked triangle. det == -Dot(line.direction, normal), culling matches the plane test
 	template<CullMode::Flag cullmode = CullMode::front, int N, typename T, typename = void>
-	bool Intersect(Intersection<N, T>& result, const Line<N, T>& line, typename Mesh<N, T>::MeshData::Triangle const& triangle)
+	bool Intersect(Intersection<N, T>& result, const Line<N, T>& line, TriangleRecord<N, T> const& triangle)
 	{
 		if constexpr (cullmode == CullMode::none)
 		{
@@ -135,50 +141,215 @@ namespace JL
 		else
 		{
 
-			Intersection<N, T> intersection{};
-			Plane<N, T> plane{ *triangle.x, *triangle.y, *triangle.z };
-			if (!Intersect<cullmode, N, T, void>(intersection, line, plane))
-				return false;
+			Vector<N, T> const p{ Cross(line.direction, triangle.edge2) };
+			T const det{ Dot(triangle.edge1, p) };
 
-			Point<N, T> const pos{ line(intersection) };
-			Vector<N, T> const distance{ pos - *triangle.x };
-
-			Vector<N, T> const side1{ *triangle.y - *triangle.x };
-			if (Dot(plane.normal, Cross(side1, distance)) < 0)
+			if (Conditional<cullmode & CullFlag::both>(
+				det == static_cast<T>(0),
+				Conditional<cullmode & CullFlag::front>(
+					det < static_cast<T>(0),
+					det > static_cast<T>(0)
+				)
+			))
 				return false;
 
-			Vector<N, T> const side2{ *triangle.z - *triangle.x };
-			if (Dot(plane.normal, Cross(side2, distance)) > 0)
+			T const inverse{ static_cast<T>(1) / det };
+
+			Vector<N, T> const distance{ line.origin - triangle.origin };
+			T const u{ Dot(distance, p) * inverse };
+			if (u < static_cast<T>(0) || u > static_cast<T>(1))
 				return false;
 
-			Vector<N, T> const distance3{ pos - *triangle.y };
-			Vector<N, T> const side3{ *triangle.z - *triangle.y };
-			if (Dot(plane.normal, Cross(side3, distance3)) < 0)
+			Vector<N, T> const q{ Cross(distance, triangle.edge1) };
+			T const v{ Dot(line.direction, q) * inverse };
+			if (v < static_cast<T>(0) || u + v > static_cast<T>(1))
 				return false;
 
-			result = intersection;
+			result = Dot(triangle.edge2, q) * inverse;
 			result.hitFace = &triangle;
+			result.u = u;
+			result.v = v;
 			return true;
 
 		}
 	}
 
-	template<CullMode::Flag cullmode = CullMode::front, int N, typename T, typename = void>
-	bool Intersect(Intersection<N, T>& result, const Line<N, T>& line, typename Mesh<N, T> const& mesh)
+	// Closest (or any) hit within [tMin, tMax), traversing the mesh's hierarchy front to back
+	template<CullMode::Flag cullmode = CullMode::front, bool anyHit = false, int N, typename T>
+	bool Intersect(Intersection<N, T>& result, const Line<N, T>& line, Mesh<N, T> const& mesh, T const& tMin, T const& tMax)
 	{
-		return std::any_of(
-			mesh.begin(), mesh.end(),
-			[&result, &line](auto const& triangle)
+		auto const& records{ mesh.GetRecords() };
+		auto const hitTriangle = [&result, &line, &records](auto const index, T const& tMin, T& tMax)
+		{
+			Intersection<N, T> intersection{};
+			if (Intersect<cullmode, N, T, void>(intersection, line, records[index]) && intersection >= tMin && intersection < tMax)
 			{
-				return Intersect<cullmode, N, T, void>(result, line, triangle);
+				result = intersection;
+				tMax = intersection;
+				return true;
+			}
+			return false;
+		};
+		if (mesh.IsLazy())
+			return mesh.GetLazyHierarchy().template Traverse<anyHit>(line, tMin, tMax, hitTriangle);
+		return mesh.GetHierarchy().template Traverse<anyHit>(line, tMin, tMax, hitTriangle);
+	}
+
+	// One line against the W spheres from first in the cluster at index at once, the closest hit within [tMin, tMax) with hitFace on its sphere.
+	// Culling as for packets of single spheres: front takes the near root, back the far one, both the nearest at or beyond tMin
+	template<CullMode::Flag cullmode, int W, int N>
+	bool IntersectLanes(Intersection<N, float>& result, const Line<N, float>& line, SphereSet<N, float> const& set, typename SphereSet<N, float>::Index index, int first, float tMin, float tMax)
+	{
+		using Lanes = simd::Lanes<W>;
+		auto const& cluster{ set.GetClusters()[index] };
+
+		Lanes distance[N];
+		for (int axis{}; axis < N; ++axis)
+			distance[axis] = Lanes::Broadcast(line.origin.data[axis]) - Lanes::Load(cluster.center[axis] + first);
+
+		Lanes dot{ distance[0] * distance[0] };
+		Lanes b{ distance[0] * Lanes::Broadcast(line.direction.data[0]) };
+		for (int axis{ 1 }; axis < N; ++axis)
+		{
+			dot = dot + distance[axis] * distance[axis];
+			b = b + distance[axis] * Lanes::Broadcast(line.direction.data[axis]);
+		}
+
+		const Lanes a{ Lanes::Broadcast(Dot(line.direction, line.direction)) };
+		b = b * Lanes::Broadcast(2.f);
+		const Lanes c{ dot - Lanes::Load(cluster.squareRadius + first) };
+		const Lanes d{ b * b - a * c * Lanes::Broadcast(4.f) };
+
+		// most clusters a ray reaches are missed by all of their spheres
+		const Lanes zero{ Lanes::Broadcast(0.f) };
+		const simd::Mask<W> touched{ d >= zero };
+		if (!touched.Any())
+			return false;
+
+		const Lanes root{ Sqrt(Max(d, zero)) };
+		const Lanes divisor{ a * Lanes::Broadcast(2.f) };
+		const Lanes low{ Lanes::Broadcast(tMin) };
+
+		Lanes t{};
+		if constexpr (bool(cullmode & CullFlag::both))
+		{
+			const Lanes first{ (-b - root) / divisor };
+			const Lanes second{ (-b + root) / divisor };
+			const Lanes near{ Min(first, second) };
+			t = Select(near >= low, near, Max(first, second));
+		}
+		else if constexpr (bool(cullmode & CullFlag::front))
+			t = (-b - root) / divisor;
+		else
+			t = (-b + root) / divisor;
+
+		const simd::Mask<W> valid{ touched & (t >= low) & (t < Lanes::Broadcast(tMax)) };
+		if (!valid.Any())
+			return false;
+
+		const float closest{ simd::ReduceMin(Select(valid, t, Lanes::Broadcast(std::numeric_limits<float>::infinity()))) };
+		int lane{};
+		for (uint32_t bits{ (valid & (t <= Lanes::Broadcast(closest))).Bits() }; !((bits >> lane) & 1u);)
+			++lane;
+
+		result = closest;
+		result.hitFace = &set.GetSpheres()[cluster.spheres[first + lane]];
+		return true;
+	}
+
+	// One line against the WIDTH spheres of the cluster at index, as IntersectLanes.
+	// Whole clusters need AVX2 lanes, which MSVC compiles in for any cpu, so without them a cluster is done as halves of 4 lanes
+	template<CullMode::Flag cullmode = CullMode::front, int N>
+	bool Intersect(Intersection<N, float>& result, const Line<N, float>& line, SphereSet<N, float> const& set, typename SphereSet<N, float>::Index index, float tMin, float tMax)
+	{
+		constexpr int W{ SphereSet<N, float>::WIDTH };
+		static_assert(W % 4 == 0, "clusters split into halves of 4 lanes");
+		static const bool wide{ simd::DetectWidth() >= W };
+		if (wide)
+			return IntersectLanes<cullmode, W>(result, line, set, index, 0, tMin, tMax);
+
+		bool found{ false };
+		for (int first{}; first < W; first += 4)
+		{
+			if (IntersectLanes<cullmode, 4>(result, line, set, index, first, tMin, tMax))
+			{
+				found = true;
+				tMax = result;
+			}
+		}
+		return found;
+	}
+
+	// Closest (or any) hit within [tMin, tMax), traversing the set's clusters front to back
+	template<CullMode::Flag cullmode = CullMode::front, bool anyHit = false, int N, typename T>
+	bool Intersect(Intersection<N, T>& result, const Line<N, T>& line, SphereSet<N, T> const& set, T const& tMin, T const& tMax)
+	{
+		static_assert(std::is_same_v<T, float>, "Clusters are intersected in single precision");
+		return set.GetHierarchy().template Traverse<anyHit>(
+			line, tMin, tMax,
+			[&result, &line, &set](auto const index, T const& tMin, T& tMax)
+			{
+				if (!Intersect<cullmode, N>(result, line, set, index, tMin, tMax))
+					return false;
+				tMax = result;
+				return true;
 			}
 		);
 	}
 
+	// Culling is relative to the line direction, reversing the line swaps front and back
+	template<CullMode::Flag cullmode>
+	constexpr CullMode::Flag Reversed = (cullmode & CullFlag::both) ? cullmode : (cullmode ^ CullFlag::front);
+
+	template<CullMode::Flag cullmode = CullMode::front, bool behind = false, bool anyHit = false, int N, typename T>
+	bool Intersect(Intersection<N, T>& result, const Ray<N, T>& ray, Mesh<N, T> const& mesh, T const& tMax)
+	{
+		if constexpr (!behind)
+			return Intersect<cullmode, anyHit, N, T>(result, ray, mesh, ray.tMin, tMax);
+		else
+		{
+			// Trace backwards so the hierarchy is still visited front to back
+			const Line<N, T> reversed{ ray.origin, -ray.direction };
+			if (!Intersect<Reversed<cullmode>, anyHit, N, T>(result, reversed, mesh, ray.tMin, tMax))
+				return false;
+			result = -result.t;
+			return true;
+		}
+	}
+
+	// The ray is brought into the instance's object space, hits keep their distance along it
+	template<CullMode::Flag cullmode = CullMode::front, bool behind = false, bool anyHit = false, int N, typename T>
+	bool Intersect(Intersection<N, T>& result, const Ray<N, T>& ray, MeshInstance<N, T> const& instance, T const& tMax)
+	{
+		const Ray<N, T> local{ instance.ToObject(ray.origin), instance.ToObject(ray.direction) };
+		return Intersect<cullmode, behind, anyHit, N, T>(result, local, instance.GetMesh(), tMax);
+	}
+
+	template<CullMode::Flag cullmode = CullMode::front, bool behind = false, bool anyHit = false, int N, typename T>
+	bool Intersect(Intersection<N, T>& result, const Ray<N, T>& ray, SphereSet<N, T> const& set, T const& tMax)
+	{
+		if constexpr (!behind)
+			return Intersect<cullmode, anyHit, N, T>(result, ray, set, ray.tMin, tMax);
+		else
+		{
+			const Line<N, T> reversed{ ray.origin, -ray.direction };
+			if (!Intersect<Reversed<cullmode>, anyHit, N, T>(result, reversed, set, ray.tMin, tMax))
+				return false;
+			result = -result.t;
+			return true;
+		}
+	}
+
+	// Objects that traverse a hierarchy of their own, they take tMax along to it
+	template<int N, typename T, typename Object>
+	constexpr bool HAS_HIERARCHY = std::is_same_v<Object, Mesh<N, T>> || std::is_same_v<Object, MeshInstance<N, T>> || std::is_same_v<Object, SphereSet<N, T>>;
+
 	template<CullMode::Flag cullmode = CullMode::front, bool behind = false, int N, typename T, template<int, typename> typename Object>
 	bool Intersect(Intersection<N, T>& result, const Ray<N, T>& ray, const Object<N, T>& object)
 	{
-		if constexpr(!behind)
+		if constexpr (HAS_HIERARCHY<N, T, Object<N, T>>)
+			return Intersect<cullmode, behind, false, N, T>(result, ray, object, ray.tMax);
+		else if constexpr(!behind)
 			return Intersect<cullmode, N, T, void>(result, ray, object) && result >= ray.tMin && result < ray.tMax;
 		else
 			return Intersect<cullmode, N, T, void>(result, ray, object) && result <= -ray.tMin && result > -ray.tMax;
@@ -207,6 +378,95 @@ namespace JL
 		return Intersect<behind, N, T, Object>(t, ray, object, cullmode);
 	}
 
+	// Shadow query: is there any hit closer than tMax (or further than -tMax when looking behind)
+	// Meshes and sphere sets stop traversing at the first hit found, instead of searching for the closest.
+	template<CullMode::Flag cullmode, bool behind = false, int N, typename T, template<int, typename> typename Object>
+	bool Occluded(const Ray<N, T>& ray, const Object<N, T>& object, T const& tMax)
+	{
+		Intersection<N, T> t{};
+		if constexpr (HAS_HIERARCHY<N, T, Object<N, T>>)
+			return Intersect<cullmode, behind, true, N, T>(t, ray, object, tMax);
+		else if constexpr (!behind)
+			return Intersect<cullmode, behind, N, T, Object>(t, ray, object) && t < tMax;
+		else
+			return Intersect<cullmode, behind, N, T, Object>(t, ray, object) && t > -tMax;
+	}
+
+	template<bool behind = false, int N, typename T, template<int, typename> typename Object>
+	bool Occluded(const Ray<N, T>& ray, const Object<N, T>& object, CullMode::Flag cullmode, T const& tMax)
+	{
+		switch (cullmode)
+		{
+		case CullMode::front:
+			return Occluded<CullMode::front, behind, N, T, Object>(ray, object, tMax);
+		case CullMode::both:
+			return Occluded<CullMode::both, behind, N, T, Object>(ray, object, tMax);
+		case CullMode::back:
+			return Occluded<CullMode::back, behind, N, T, Object>(ray, object, tMax);
+		default:
+			return false;
+		}
+	}
+
+	// Bounds of an object. Returns false when the object is unbounded (or empty).
+
+	template<int N, typename T>
+	bool GetBounds(Box<N, T>&, const Plane<N, T>&)
+	{
+		return false;
+	}
+
+	template<int N, typename T>
+	bool GetBounds(Box<N, T>& result, const Circular<N, T>& round)
+	{
+		Vector<N, T> radius{};
+		for (int i{}; i < N; ++i)
+			radius.data[i] = round.radius;
+		result = Box<N, T>{ round.center - radius, round.center + radius };
+		return true;
+	}
+
+	template<int N, typename T>
+	bool GetBounds(Box<N, T>& result, const Mesh<N, T>& mesh)
+	{
+		if (mesh.IsLazy())
+		{
+			result = mesh.GetLazyHierarchy().GetBounds();
+			return true;
+		}
+		if (mesh.GetHierarchy().IsEmpty())
+			return false;
+		result = mesh.GetHierarchy().GetBounds();
+		return true;
+	}
+
+	template<int N, typename T>
+	bool GetBounds(Box<N, T>& result, const SphereSet<N, T>& set)
+	{
+		if (set.GetHierarchy().IsEmpty())
+			return false;
+		result = set.GetHierarchy().GetBounds();
+		return true;
+	}
+
+	// Bounds of the transformed mesh bounds, looser than the bounds of the transformed mesh when rotated
+	template<int N, typename T>
+	bool GetBounds(Box<N, T>& result, const MeshInstance<N, T>& instance)
+	{
+		Box<N, T> local{};
+		if (!GetBounds(local, instance.GetMesh()))
+			return false;
+		result = Box<N, T>{};
+		for (int corner{}; corner < (1 << N); ++corner)
+		{
+			Point<N, T> point{};
+			for (int axis{}; axis < N; ++axis)
+				point.data[axis] = (corner & (1 << axis)) ? local.max.data[axis] : local.min.data[axis];
+			result.Grow(instance.ToWorld(point));
+		}
+		return true;
+	}
+
 	template<int N, typename T>
 	Vector<N, T> HalfVector(Vector<N, T> const& a, Vector<N, T> const& b)
 	{
@@ -35,6 +35,8 @@ namespace JL
 	{
 		T t = 0;
 		void const* hitFace = nullptr; // infomation detail
+		T u = 0; // barycentric coordinates on hitFace, when it has them
+		T v = 0;
 
 		constexpr operator T() const noexcept
 		{
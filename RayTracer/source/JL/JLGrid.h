@@ -0,0 +1,368 @@
+// Grid.h - Uniform grid over primitive bounds, rebuilt in linear time.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include "JLBaseIncludes.h"
+#include "JLBox.h"
+#include "JLBVH.h"
+#include "JLLine.h"
+#include "JLRayPacket.h"
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <thread>
+
+namespace JL
+{
+
+	// The alternative to a BVH for scenes whose objects all move every frame, where refitting degrades and rebuilding sorts.
+	// Building is a few linear passes, each spread over the hardware threads: count the cells every primitive's bounds overlap,
+	// offsets from the counts, then fill in the primitives. Cells list their primitives in index order, whatever the threads did.
+	// Rays walk the cells they pass through front to back (3D-DDA) and stop at the first cell that ends beyond their closest hit.
+	// A primitive overlapping many cells is only tested once per ray: every ray remembers the primitives it tested in a small hashed mailbox.
+	template<int N, typename T>
+	class Grid
+	{
+	public:
+
+		using Box = Box<N, T>;
+		using Index = uint32_t;
+
+		static constexpr T CELLS_PER_PRIMITIVE = static_cast<T>(2);
+		static constexpr Index MAX_RESOLUTION = 256;       // cells along an axis
+		static constexpr Index MAILBOX_SIZE = 8;           // a power of two
+		static constexpr size_t MIN_CHUNK_SIZE = 1 << 12; // primitives, fewer are done on the calling thread
+
+		Grid() = default;
+
+		void Build(std::vector<Box> const& bounds)
+		{
+			Clear();
+			if (bounds.empty())
+				return;
+
+			for (Box const& box : bounds)
+				m_Bounds.Grow(box);
+			SetResolution(bounds.size());
+
+			Index cells{ 1 };
+			for (int axis{}; axis < N; ++axis)
+				cells *= m_Resolution[axis];
+
+			// Count, then turn the counts into every cell's first reference. The counters then serve as the cells' write positions
+			std::vector<std::atomic<Index>> counters(cells);
+			ForEachChunk(
+				bounds.size(),
+				[this, &bounds, &counters](size_t first, size_t last)
+				{
+					for (size_t primitive{ first }; primitive < last; ++primitive)
+						ForEachCell(bounds[primitive], [&counters](Index cell) { counters[cell].fetch_add(1, std::memory_order_relaxed); });
+				}
+			);
+
+			m_Offsets.resize(size_t(cells) + 1);
+			m_Offsets[0] = 0;
+			for (Index cell{}; cell < cells; ++cell)
+			{
+				m_Offsets[cell + 1] = m_Offsets[cell] + counters[cell].load(std::memory_order_relaxed);
+				counters[cell].store(m_Offsets[cell], std::memory_order_relaxed);
+			}
+
+			m_References.resize(m_Offsets.back());
+			ForEachChunk(
+				bounds.size(),
+				[this, &bounds, &counters](size_t first, size_t last)
+				{
+					for (size_t primitive{ first }; primitive < last; ++primitive)
+						ForEachCell(bounds[primitive], [this, &counters, primitive](Index cell) { m_References[counters[cell].fetch_add(1, std::memory_order_relaxed)] = static_cast<Index>(primitive); });
+				}
+			);
+
+			ForEachChunk(
+				cells,
+				[this](size_t first, size_t last)
+				{
+					for (size_t cell{ first }; cell < last; ++cell)
+						std::sort(m_References.begin() + m_Offsets[cell], m_References.begin() + m_Offsets[cell + 1]);
+				}
+			);
+		}
+
+		void Clear() noexcept
+		{
+			m_Bounds = Box{};
+			m_Offsets.clear();
+			m_References.clear();
+		}
+
+		bool IsEmpty() const noexcept
+		{
+			return m_Offsets.empty();
+		}
+
+		Box const& GetBounds() const noexcept
+		{
+			return m_Bounds;
+		}
+
+		Index GetResolution(int axis) const noexcept
+		{
+			return m_Resolution[axis];
+		}
+
+		// Same contract as BVH::Traverse: visits cells front to back.
+		// hit(Index primitive, T const& tMin, T& tMax) -> bool must only report hits within [tMin, tMax) and shrink tMax to them.
+		// With anyHit, traversal stops at the first reported hit.
+		template<bool anyHit = false, typename Hit>
+		bool Traverse(Line<N, T> const& line, T const& tMin, T tMax, Hit&& hit) const
+		{
+			if (m_Offsets.empty())
+				return false;
+
+			// Where the line enters and leaves the grid
+
+			const Vector<N, T> inverse{ GetInverse(line.direction) };
+			T near{ tMin };
+			T far{ tMax };
+			for (int axis{}; axis < N; ++axis)
+			{
+				T t0{ (m_Bounds.min.data[axis] - line.origin.data[axis]) * inverse.data[axis] };
+				T t1{ (m_Bounds.max.data[axis] - line.origin.data[axis]) * inverse.data[axis] };
+				if (t0 > t1)
+					std::swap(t0, t1);
+				near = std::max(near, t0);
+				far = std::min(far, t1);
+			}
+			if (!(near <= far))
+				return false;
+
+			// The cell entered, and per axis the step to the next cell, the distance to its boundary and between boundaries
+
+			Index cell[N]{};
+			int step[N]{};
+			T next[N]{};
+			T delta[N]{};
+			for (int axis{}; axis < N; ++axis)
+			{
+				const T direction{ line.direction.data[axis] };
+				cell[axis] = CellOf(line.origin.data[axis] + direction * near, axis);
+				if (direction == static_cast<T>(0))
+				{
+					next[axis] = std::numeric_limits<T>::infinity();
+					delta[axis] = std::numeric_limits<T>::infinity();
+					continue;
+				}
+				step[axis] = direction > static_cast<T>(0) ? 1 : -1;
+				const Index boundary{ cell[axis] + (step[axis] > 0 ? 1 : 0) };
+				next[axis] = (m_Bounds.min.data[axis] + static_cast<T>(boundary) * m_CellSize.data[axis] - line.origin.data[axis]) * inverse.data[axis];
+				delta[axis] = m_CellSize.data[axis] * std::abs(inverse.data[axis]);
+			}
+
+			Index mailbox[MAILBOX_SIZE];
+			std::fill(std::begin(mailbox), std::end(mailbox), std::numeric_limits<Index>::max());
+
+			bool found{ false };
+			while (true)
+			{
+				Index linear{ cell[N - 1] };
+				for (int axis{ N - 2 }; axis >= 0; --axis)
+					linear = linear * m_Resolution[axis] + cell[axis];
+				TraversalCounter::CountVisit(&m_Offsets[linear]);
+
+				for (Index i{ m_Offsets[linear] }; i < m_Offsets[linear + 1]; ++i)
+				{
+					const Index primitive{ m_References[i] };
+					Index& slot{ mailbox[primitive & (MAILBOX_SIZE - 1)] };
+					if (slot == primitive)
+						continue;
+					slot = primitive;
+					if (hit(primitive, tMin, tMax))
+					{
+						found = true;
+						if constexpr (anyHit)
+							return true;
+					}
+				}
+
+				// on to the neighbour across the nearest boundary, unless the cell already ends beyond the closest hit or the grid
+				int axis{};
+				for (int i{ 1 }; i < N; ++i)
+					if (next[i] < next[axis])
+						axis = i;
+				if (next[axis] >= tMax || next[axis] > far)
+					break;
+				if (step[axis] < 0 ? cell[axis] == 0 : cell[axis] + 1 >= m_Resolution[axis])
+					break;
+				cell[axis] += step[axis];
+				next[axis] += delta[axis];
+			}
+
+			return found;
+		}
+
+	private:
+
+		Box m_Bounds{};
+		Index m_Resolution[N]{};
+		Vector<N, T> m_CellSize{};
+		Vector<N, T> m_InverseCellSize{};
+		std::vector<Index> m_Offsets;    // first reference of every cell, x fastest, and one past the last
+		std::vector<Index> m_References; // primitive indices, cell by cell
+
+		// About CELLS_PER_PRIMITIVE cells per primitive, as close to cubes as the bounds allow.
+		// The bounds are padded a little, so flat scenes still get cells with a size and primitives on the faces fall inside
+		void SetResolution(size_t primitives)
+		{
+			T largest{};
+			for (int axis{}; axis < N; ++axis)
+				largest = std::max(largest, m_Bounds.max.data[axis] - m_Bounds.min.data[axis]);
+			const T padding{ std::max(largest, static_cast<T>(1)) * static_cast<T>(1e-4) };
+
+			T volume{ 1 };
+			for (int axis{}; axis < N; ++axis)
+			{
+				m_Bounds.min.data[axis] -= padding;
+				m_Bounds.max.data[axis] += padding;
+				volume *= m_Bounds.max.data[axis] - m_Bounds.min.data[axis];
+			}
+
+			const T perLength{ std::pow(CELLS_PER_PRIMITIVE * static_cast<T>(primitives) / volume, static_cast<T>(1) / static_cast<T>(N)) };
+			for (int axis{}; axis < N; ++axis)
+			{
+				const T extent{ m_Bounds.max.data[axis] - m_Bounds.min.data[axis] };
+				const T cells{ std::clamp(std::ceil(extent * perLength), static_cast<T>(1), static_cast<T>(MAX_RESOLUTION)) };
+				m_Resolution[axis] = static_cast<Index>(cells);
+				m_CellSize.data[axis] = extent / cells;
+				m_InverseCellSize.data[axis] = cells / extent;
+			}
+		}
+
+		Index CellOf(T const& value, int axis) const noexcept
+		{
+			const T cell{ (value - m_Bounds.min.data[axis]) * m_InverseCellSize.data[axis] };
+			return static_cast<Index>(std::clamp(cell, static_cast<T>(0), static_cast<T>(m_Resolution[axis] - 1)));
+		}
+
+		// function(Index cell) for every cell the box overlaps
+		template<typename Function>
+		void ForEachCell(Box const& box, Function const& function) const
+		{
+			Index low[N]{}, high[N]{};
+			for (int axis{}; axis < N; ++axis)
+			{
+				low[axis] = CellOf(box.min.data[axis], axis);
+				high[axis] = CellOf(box.max.data[axis], axis);
+			}
+
+			Index cell[N]{};
+			std::copy(std::begin(low), std::end(low), std::begin(cell));
+			while (true)
+			{
+				Index linear{ cell[N - 1] };
+				for (int axis{ N - 2 }; axis >= 0; --axis)
+					linear = linear * m_Resolution[axis] + cell[axis];
+				function(linear);
+
+				int axis{};
+				while (axis < N && cell[axis] == high[axis])
+				{
+					cell[axis] = low[axis];
+					++axis;
+				}
+				if (axis == N)
+					break;
+				++cell[axis];
+			}
+		}
+
+		// function(first, last) over about equal chunks of [0, count), one per hardware thread
+		template<typename Function>
+		static void ForEachChunk(size_t count, Function const& function)
+		{
+			const size_t chunks{ std::clamp<size_t>(count / MIN_CHUNK_SIZE, 1, std::max(1u, std::thread::hardware_concurrency())) };
+			if (chunks == 1)
+				return function(size_t{}, count);
+
+			std::vector<std::future<void>> jobs{};
+			jobs.reserve(chunks);
+			for (size_t chunk{}; chunk < chunks; ++chunk)
+				jobs.push_back(std::async(std::launch::async, [&function, first{ count * chunk / chunks }, last{ count * (chunk + 1) / chunks }]() { function(first, last); }));
+			for (auto& job : jobs)
+				job.get();
+		}
+
+	};
+
+	// Packet traversal of a grid, same contract as for a BVH. Lanes walk their own cells one after the other,
+	// hit is called with the lane alone active
+	template<bool anyHit = false, int N, int W, typename Hit>
+	simd::Mask<W> Traverse(Grid<N, float> const& grid, RayPacket<N, W> const& packet, simd::Lanes<W>& tMax, simd::Mask<W> active, Hit&& hit)
+	{
+		using Mask = simd::Mask<W>;
+
+		float origins[N][W], directions[N][W], tMins[W];
+		for (int axis{}; axis < N; ++axis)
+		{
+			packet.origin[axis].Store(origins[axis]);
+			packet.direction[axis].Store(directions[axis]);
+		}
+		packet.tMin.Store(tMins);
+
+		uint32_t found{};
+		simd::ForEachLane(
+			active,
+			[&](int lane)
+			{
+				Line<N, float> line{};
+				for (int axis{}; axis < N; ++axis)
+				{
+					line.origin.data[axis] = origins[axis][lane];
+					line.direction.data[axis] = directions[axis][lane];
+				}
+
+				float limits[W];
+				tMax.Store(limits);
+				const Mask single{ Mask::FromBits(1u << lane) };
+				const bool hits{ grid.template Traverse<anyHit>(
+					line, tMins[lane], limits[lane],
+					[&hit, &tMax, single, lane](typename Grid<N, float>::Index primitive, float const&, float& limit)
+					{
+						if (!hit(primitive, tMax, single).Any())
+							return false;
+						float values[W];
+						tMax.Store(values);
+						limit = values[lane];
+						return true;
+					}
+				) };
+				if (hits)
+					found |= 1u << lane;
+			}
+		);
+		return Mask::FromBits(found);
+	}
+
+}
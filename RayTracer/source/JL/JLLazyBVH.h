@@ -0,0 +1,334 @@
+// LazyBVH.h - Bounding volume hierarchy that splits its nodes only once a traversal first reaches them.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include "JLBaseIncludes.h"
+#include "JLBox.h"
+#include "JLLine.h"
+#include "JLBVH.h"
+#include <vector>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <atomic>
+#include <numeric>
+#include <thread>
+#include <cstdint>
+
+namespace JL
+{
+
+	// Building only takes the primitive bounds, the root covers all of them and is not split yet.
+	// A node is split the first time a traversal reaches it, with the same binned surface area heuristic as a BVH,
+	// so the tree only grows where rays actually go and the first ones can be traced right away.
+	// Traversals may run concurrently, every node is split by the first thread to reach it while the others wait for it.
+	// Building, translating, copying and assigning must not overlap with any traversal.
+	template<int N, typename T>
+	class LazyBVH
+	{
+	public:
+
+		using Value = T;
+		using Box = Box<N, T>;
+		using Binary = BVH<N, T>;
+		using Index = typename Binary::Index;
+
+		static constexpr size_t STACK_SIZE = Binary::STACK_SIZE;
+
+		// Nodes are laid out depth first like in a BVH, a subtree over count primitives taking at most 2 * count - 1 slots.
+		// A node's children go where the full build would put them, so splitting never moves or allocates nodes.
+		// The slots are left uninitialised until a node is put in them, so the pages of subtrees no ray reaches are never touched
+		struct Node
+		{
+			Box bounds;
+			Index offset; // interior: index of the right child (left child follows its parent). otherwise: first primitive index
+			Index count;  // 0 for interior nodes
+			std::atomic<uint8_t> state;
+			uint8_t depth;
+
+			// Only for nodes that are ready
+			bool IsLeaf() const noexcept
+			{
+				return count != 0;
+			}
+		};
+
+		LazyBVH() = default;
+
+		LazyBVH(LazyBVH&&) noexcept = default;
+		LazyBVH& operator = (LazyBVH&&) noexcept = default;
+
+		// Copies start over from the primitive bounds
+		LazyBVH(LazyBVH const& other)
+		{
+			Build(other.m_Bounds);
+		}
+
+		LazyBVH& operator = (LazyBVH const& other)
+		{
+			if (this != &other)
+				Build(other.m_Bounds);
+			return *this;
+		}
+
+		void Build(std::vector<Box> bounds)
+		{
+			m_Bounds = std::move(bounds);
+			m_Indices.resize(m_Bounds.size());
+			std::iota(m_Indices.begin(), m_Indices.end(), Index{});
+			m_Nodes.reset();
+
+			if (m_Bounds.empty())
+				return;
+
+			m_Nodes = Nodes{ std::allocator<Node>{}.allocate(Capacity()), Release{ Capacity() } };
+			Prepare(0, 0, static_cast<Index>(m_Bounds.size()), 0);
+		}
+
+		void Clear() noexcept
+		{
+			m_Bounds.clear();
+			m_Indices.clear();
+			m_Nodes.reset();
+		}
+
+		bool IsEmpty() const noexcept
+		{
+			return m_Bounds.empty();
+		}
+
+		Box const& GetBounds() const noexcept
+		{
+			return m_Nodes[0].bounds;
+		}
+
+		// Only the root and the children of ready interior nodes were put in their slots, the others are uninitialised
+		Node const* GetNodes() const noexcept
+		{
+			return m_Nodes.get();
+		}
+
+		// Only valid within the ranges of leaves that are ready
+		std::vector<Index> const& GetIndices() const noexcept
+		{
+			return m_Indices;
+		}
+
+		// Splits the node at index if that has not happened yet and returns it, ready
+		Node const& Expand(Index index) const
+		{
+			Node& node{ m_Nodes[index] };
+			if (node.state.load(std::memory_order_acquire) != READY)
+			{
+				uint8_t expected{ PENDING };
+				if (node.state.compare_exchange_strong(expected, SPLITTING, std::memory_order_acquire))
+				{
+					Split(index);
+					node.state.store(READY, std::memory_order_release);
+				}
+				else
+				{
+					while (node.state.load(std::memory_order_acquire) != READY)
+						std::this_thread::yield();
+				}
+			}
+			return node;
+		}
+
+		void Translate(Vector<N, T> const& translation) noexcept
+		{
+			for (Box& box : m_Bounds)
+				box.Translate(translation);
+			if (m_Bounds.empty())
+				return;
+
+			// only the nodes that were put in a slot, the children of ready interior nodes
+			Index stack[STACK_SIZE];
+			size_t size{};
+			Index current{ 0 };
+			while (true)
+			{
+				Node& node{ m_Nodes[current] };
+				node.bounds.Translate(translation);
+				if (node.state.load(std::memory_order_relaxed) == READY && !node.IsLeaf())
+				{
+					stack[size++] = node.offset;
+					++current;
+					continue;
+				}
+				if (size == 0)
+					break;
+				current = stack[--size];
+			}
+		}
+
+		// Same contract as BVH::Traverse
+		template<bool anyHit = false, typename Hit>
+		bool Traverse(Line<N, T> const& line, T const& tMin, T tMax, Hit&& hit) const
+		{
+			if (m_Bounds.empty())
+				return false;
+
+			const Vector<N, T> inverse{ GetInverse(line.direction) };
+
+			T entry{};
+			if (!Intersect(entry, line.origin, inverse, m_Nodes[0].bounds, tMin, tMax))
+				return false;
+
+			struct Entry
+			{
+				Index node;
+				T t;
+			} stack[STACK_SIZE];
+			size_t size{};
+
+			bool found{ false };
+			Index current{ 0 };
+
+			while (true)
+			{
+				Node const& node{ Expand(current) };
+				TraversalCounter::CountVisit(&node);
+				if (node.IsLeaf())
+				{
+					for (Index i{ node.offset }; i < node.offset + node.count; ++i)
+					{
+						if (hit(m_Indices[i], tMin, tMax))
+						{
+							found = true;
+							if constexpr (anyHit)
+								return true;
+						}
+					}
+				}
+				else
+				{
+					Index near{ current + 1 };
+					Index far{ node.offset };
+					T nearT{}, farT{};
+					const bool nearHit{ Intersect(nearT, line.origin, inverse, m_Nodes[near].bounds, tMin, tMax) };
+					const bool farHit{ Intersect(farT, line.origin, inverse, m_Nodes[far].bounds, tMin, tMax) };
+
+					if (nearHit && farHit)
+					{
+						if (farT < nearT)
+						{
+							std::swap(near, far);
+							std::swap(nearT, farT);
+						}
+						stack[size++] = { far, farT };
+						current = near;
+						continue;
+					}
+					else if (nearHit)
+					{
+						current = near;
+						continue;
+					}
+					else if (farHit)
+					{
+						current = far;
+						continue;
+					}
+				}
+
+				// pop the next node that can still hold a closer hit
+				while (size != 0 && stack[size - 1].t > tMax)
+					--size;
+				if (size == 0)
+					break;
+				current = stack[--size].node;
+			}
+
+			return found;
+		}
+
+	private:
+
+		static constexpr uint8_t PENDING = 1;
+		static constexpr uint8_t SPLITTING = 2;
+		static constexpr uint8_t READY = 3;
+
+		// Hands the slots back without destroying them, nodes are trivially destructible
+		struct Release
+		{
+			size_t capacity;
+
+			void operator () (Node* pNodes) const noexcept
+			{
+				std::allocator<Node>{}.deallocate(pNodes, capacity);
+			}
+		};
+		using Nodes = std::unique_ptr<Node[], Release>;
+		static_assert(std::is_trivially_destructible_v<Node>, "slots are released without destroying their nodes");
+
+		std::vector<Box> m_Bounds; // by primitive
+		mutable std::vector<Index> m_Indices; // splitting a node only reorders its own range
+		Nodes m_Nodes;
+
+		size_t Capacity() const noexcept
+		{
+			return m_Bounds.empty() ? 0 : m_Bounds.size() * 2 - 1;
+		}
+
+		// Puts a pending node over the count primitives from first in the slot at index
+		void Prepare(Index index, Index first, Index count, uint8_t depth) const noexcept
+		{
+			Node& node{ *::new (static_cast<void*>(m_Nodes.get() + index)) Node };
+			for (Index i{ first }; i < first + count; ++i)
+				node.bounds.Grow(m_Bounds[m_Indices[i]]);
+			node.offset = first;
+			node.count = count;
+			node.depth = depth;
+			node.state.store(PENDING, std::memory_order_relaxed); // published along with the parent
+		}
+
+		// Either leaves the node at index a leaf, or prepares its children and makes it interior
+		void Split(Index index) const
+		{
+			Node& node{ m_Nodes[index] };
+			const Index first{ node.offset };
+			const Index count{ node.count };
+
+			if (count <= 1 || node.depth + 1u >= STACK_SIZE) // traversal never needs more stack than the tree is deep
+				return;
+
+			Box centroidBounds{};
+			for (Index i{ first }; i < first + count; ++i)
+				centroidBounds.Grow(m_Bounds[m_Indices[i]].Centroid());
+
+			typename Binary::Plane plane{};
+			if (!Binary::FindPlane(plane, m_Bounds, m_Indices.data() + first, count, node.bounds, centroidBounds))
+				return;
+			const Index leftCount{ Binary::Partition(plane, m_Bounds, m_Indices.data() + first, count) };
+
+			const Index rightIndex{ index + 2 * leftCount }; // past the largest left subtree
+			Prepare(index + 1, first, leftCount, static_cast<uint8_t>(node.depth + 1));
+			Prepare(rightIndex, first + leftCount, count - leftCount, static_cast<uint8_t>(node.depth + 1));
+
+			node.offset = rightIndex;
+			node.count = 0;
+		}
+
+	};
+
+}
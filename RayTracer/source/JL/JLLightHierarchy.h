@@ -0,0 +1,217 @@
+// LightHierarchy.h - Picks one of many lights by its importance to a surface point.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include "JLBaseIncludes.h"
+#include "JLBox.h"
+#include "JLBVH.h"
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+namespace JL
+{
+
+	// Positional lights (point lights) go into a BVH whose nodes also hold the total power of the lights below them.
+	// Distant lights (directional lights) have no position, they are picked by power alone.
+	// Walking down the hierarchy, every step picks a child by its importance to the point: power over squared distance,
+	// none for nodes entirely behind the surface. Every light that can light the point keeps a chance to be picked,
+	// so weighting its contribution by 1 / pdf gives an unbiased estimate of all lights together.
+	// Only knows positions and powers, indices refer to the order they were given in: rebuild whenever the lights change.
+	template<int N, typename T>
+	class LightHierarchy
+	{
+	public:
+
+		using Hierarchy = BVH<N, T>;
+		using Index = typename Hierarchy::Index;
+
+		struct Sample
+		{
+			Index light;  // into the positional or the distant lights
+			bool distant;
+			T pdf;        // probability the light was picked with
+		};
+
+		LightHierarchy() = default;
+
+		// powers: any measure of how bright the lights are, as long as they are positive
+		void Build(std::vector<Point<N, T>> const& positions, std::vector<T> const& powers, std::vector<T> const& distantPowers)
+		{
+			m_Positions = positions;
+			m_Powers = powers;
+
+			std::vector<Box<N, T>> bounds{};
+			bounds.reserve(positions.size());
+			for (Point<N, T> const& position : positions)
+				bounds.push_back(Box<N, T>{ position, position });
+			m_Hierarchy.Build(bounds);
+
+			// Node powers bottom up: children always come after their parent
+			auto const& nodes{ m_Hierarchy.GetNodes() };
+			auto const& indices{ m_Hierarchy.GetIndices() };
+			m_NodePowers.assign(nodes.size(), T{});
+			for (size_t index{ nodes.size() }; index-- > 0;)
+			{
+				auto const& node{ nodes[index] };
+				if (node.IsLeaf())
+					for (Index i{ node.offset }; i < node.offset + node.count; ++i)
+						m_NodePowers[index] += powers[indices[i]];
+				else
+					m_NodePowers[index] = m_NodePowers[index + 1] + m_NodePowers[node.offset];
+			}
+
+			// Distant lights by their cumulative power
+			m_DistantCumulative.resize(distantPowers.size());
+			T sum{};
+			for (size_t light{}; light < distantPowers.size(); ++light)
+				m_DistantCumulative[light] = sum += distantPowers[light];
+		}
+
+		// Picks a light for the point on a surface with the normal, u uniform in [0, 1).
+		// False when no light can reach the point
+		bool Pick(Sample& sample, Point<N, T> const& point, Vector<N, T> const& normal, T u) const
+		{
+			// Positional against distant lights, then down the hierarchy. u is rescaled to [0, 1) after every choice
+
+			const T positional{ m_Hierarchy.GetNodes().empty() ? T{} : NodeImportance(0, point, normal) };
+			const T distant{ m_DistantCumulative.empty() ? T{} : m_DistantCumulative.back() };
+			if (!(positional + distant > 0))
+				return false;
+
+			T pdf{};
+			if (!Choose(u, pdf, positional, distant))
+			{
+				const T target{ u * distant };
+				const auto found{ std::upper_bound(m_DistantCumulative.begin(), m_DistantCumulative.end(), target) };
+				const Index light{ static_cast<Index>(std::min<size_t>(found - m_DistantCumulative.begin(), m_DistantCumulative.size() - 1)) };
+				const T power{ m_DistantCumulative[light] - (light == 0 ? T{} : m_DistantCumulative[light - 1]) };
+				sample = Sample{ light, true, pdf * power / distant };
+				return sample.pdf > 0;
+			}
+
+			auto const& nodes{ m_Hierarchy.GetNodes() };
+			auto const& indices{ m_Hierarchy.GetIndices() };
+			Index current{ 0 };
+			while (!nodes[current].IsLeaf())
+			{
+				const Index left{ current + 1 };
+				const Index right{ nodes[current].offset };
+				const T leftImportance{ NodeImportance(left, point, normal) };
+				const T rightImportance{ NodeImportance(right, point, normal) };
+				if (!(leftImportance + rightImportance > 0))
+					return false; // every light below is behind the surface
+
+				T probability{};
+				current = Choose(u, probability, leftImportance, rightImportance) ? left : right;
+				pdf *= probability;
+			}
+
+			// Within the leaf, light by light
+			auto const& leaf{ nodes[current] };
+			T total{};
+			for (Index i{ leaf.offset }; i < leaf.offset + leaf.count; ++i)
+				total += LightImportance(indices[i], point, normal);
+			if (!(total > 0))
+				return false;
+
+			T target{ u * total };
+			for (Index i{ leaf.offset }; i < leaf.offset + leaf.count; ++i)
+			{
+				const T importance{ LightImportance(indices[i], point, normal) };
+				if (importance > 0 && (target < importance || i + 1 == leaf.offset + leaf.count))
+				{
+					sample = Sample{ indices[i], false, pdf * importance / total };
+					return true;
+				}
+				target -= importance;
+			}
+			return false;
+		}
+
+	private:
+
+		Hierarchy m_Hierarchy;
+		std::vector<Point<N, T>> m_Positions;
+		std::vector<T> m_Powers;
+		std::vector<T> m_NodePowers;
+		std::vector<T> m_DistantCumulative;
+
+		// Takes the first option with probability first / (first + second), else the second. Their sum must be positive.
+		// Returns whether the first was taken, with its probability, and rescales u to [0, 1) within the choice
+		static bool Choose(T& u, T& probability, T const& first, T const& second) noexcept
+		{
+			const T total{ first + second };
+			const T p{ first / total };
+			if (u < p)
+			{
+				u = std::min(u / p, T{ 1 } - std::numeric_limits<T>::epsilon());
+				probability = p;
+				return true;
+			}
+			u = std::min((u - p) / (T{ 1 } - p), T{ 1 } - std::numeric_limits<T>::epsilon());
+			probability = T{ 1 } - p;
+			return false;
+		}
+
+		// Power over the squared distance to the box centre, no closer than the box's own size so nearby nodes are not overrated.
+		// None when every corner is behind the surface
+		T NodeImportance(Index index, Point<N, T> const& point, Vector<N, T> const& normal) const
+		{
+			Box<N, T> const& bounds{ m_Hierarchy.GetNodes()[index].bounds };
+
+			bool inFront{ false };
+			for (int corner{}; corner < (1 << N) && !inFront; ++corner)
+			{
+				T side{};
+				for (int axis{}; axis < N; ++axis)
+				{
+					const T position{ ((corner >> axis) & 1) ? bounds.max.data[axis] : bounds.min.data[axis] };
+					side += (position - point.data[axis]) * normal.data[axis];
+				}
+				inFront = side > 0;
+			}
+			if (!inFront)
+				return T{};
+
+			T squareDistance{}, squareSize{};
+			for (int axis{}; axis < N; ++axis)
+			{
+				const T centre{ (bounds.min.data[axis] + bounds.max.data[axis]) / 2 };
+				const T half{ (bounds.max.data[axis] - bounds.min.data[axis]) / 2 };
+				squareDistance += (centre - point.data[axis]) * (centre - point.data[axis]);
+				squareSize += half * half;
+			}
+			return m_NodePowers[index] / std::max({ squareDistance, squareSize, std::numeric_limits<T>::min() });
+		}
+
+		T LightImportance(Index light, Point<N, T> const& point, Vector<N, T> const& normal) const
+		{
+			const Vector<N, T> offset{ m_Positions[light] - point };
+			if (!(Dot(offset, normal) > 0))
+				return T{};
+			return m_Powers[light] / std::max(SqrMagnitude(offset), std::numeric_limits<T>::min());
+		}
+
+	};
+
+}
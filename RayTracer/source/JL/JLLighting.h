@@ -25,6 +25,8 @@
 #include "JLBaseIncludes.h"
 #include "JLDirectionalLight.h"
 #include "JLPointLight.h"
+#include <cmath>
+#include <limits>
 
 namespace JL
 {
@@ -35,6 +37,15 @@ namespace JL
 		return source.intensity / squareDistance;
 	}
 
+	// Distance beyond which the light's intensity falls below cutoff, without bound when cutoff is not positive
+	template<int N, typename T>
+	T InfluenceRadius(PointLight<N, T> const& source, T const& cutoff)
+	{
+		if (!(cutoff > 0))
+			return std::numeric_limits<T>::infinity();
+		return std::sqrt(source.intensity / cutoff);
+	}
+
 	template<int N, typename T>
 	T LightIntensity(DirectionalLight<N, T> const& source, T const& /*discarded*/ = {})
 	{
@@ -0,0 +1,99 @@
+#include "JLMappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace JL
+{
+
+#ifdef _WIN32
+
+	MappedFile::MappedFile(std::string const& filePath)
+		: m_pData{ nullptr }
+		, m_Size{ 0 }
+		, m_Open{ false }
+		, m_File{ INVALID_HANDLE_VALUE }
+		, m_Mapping{ nullptr }
+	{
+		m_File = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (m_File == INVALID_HANDLE_VALUE)
+			return;
+
+		LARGE_INTEGER size{};
+		if (!GetFileSizeEx(m_File, &size))
+			return;
+		m_Size = static_cast<size_t>(size.QuadPart);
+
+		// empty files can not be mapped, there is nothing to read either
+		if (m_Size == 0)
+		{
+			m_Open = true;
+			return;
+		}
+
+		m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_Mapping == nullptr)
+			return;
+
+		m_pData = static_cast<char const*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+		m_Open = m_pData != nullptr;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (m_pData != nullptr)
+			UnmapViewOfFile(m_pData);
+		if (m_Mapping != nullptr)
+			CloseHandle(m_Mapping);
+		if (m_File != INVALID_HANDLE_VALUE)
+			CloseHandle(m_File);
+	}
+
+#else
+
+	MappedFile::MappedFile(std::string const& filePath)
+		: m_pData{ nullptr }
+		, m_Size{ 0 }
+		, m_Open{ false }
+	{
+		const int file{ open(filePath.c_str(), O_RDONLY) };
+		if (file < 0)
+			return;
+
+		struct stat status{};
+		if (fstat(file, &status) == 0)
+		{
+			m_Size = static_cast<size_t>(status.st_size);
+			if (m_Size == 0)
+				m_Open = true;
+			else
+			{
+				void* const data{ mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0) };
+				if (data != MAP_FAILED)
+				{
+					madvise(data, m_Size, MADV_SEQUENTIAL);
+					m_pData = static_cast<char const*>(data);
+					m_Open = true;
+				}
+			}
+		}
+		close(file); // the mapping stays valid
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (m_pData != nullptr)
+			munmap(const_cast<char*>(m_pData), m_Size);
+	}
+
+#endif
+
+}
@@ -0,0 +1,70 @@
+// MappedFile.h - Read only memory mapped files.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+namespace JL
+{
+
+	// Maps a whole file into memory for reading, the operating system pages it in on demand.
+	// Nothing is copied: the text stays valid for as long as the MappedFile lives.
+
+	class MappedFile final
+	{
+	public:
+
+		explicit MappedFile(std::string const& filePath);
+		~MappedFile();
+
+		MappedFile(MappedFile const&) = delete;
+		MappedFile(MappedFile&&) = delete;
+		MappedFile& operator = (MappedFile const&) = delete;
+		MappedFile& operator = (MappedFile&&) = delete;
+
+		// False when the file could not be opened or mapped
+		bool IsOpen() const noexcept
+		{
+			return m_Open;
+		}
+
+		std::string_view GetText() const noexcept
+		{
+			return { m_pData, m_Size };
+		}
+
+	private:
+
+		char const* m_pData;
+		size_t m_Size;
+		bool m_Open;
+
+#ifdef _WIN32
+		void* m_File;
+		void* m_Mapping;
+#endif
+
+	};
+
+}
@@ -22,8 +22,14 @@
 
 #pragma once
 #include "JLBaseIncludes.h"
+#include "JLWideBVH.h"
+#include "JLLazyBVH.h"
 #include <vector>
 #include <utility>
+#include <cstdint>
+#include <type_traits>
+#include <future>
+#include <chrono>
 
 namespace JL
 {
@@ -42,12 +48,36 @@ namespace JL
 		Vertex center{};
 	};
 
+	// Vertex indices of a triangle. Trivially copyable, and valid wherever the vertices are moved to
+	template<typename Index_t>
+	struct IndexTriangle
+	{
+		using Index = Index_t;
+		Index x, y, z;
+	};
+
+	// Baked per triangle for intersection: the first vertex, both edges leaving it and the (unnormalized) face normal
+	template<int N, typename T>
+	struct TriangleRecord
+	{
+		Point<N, T> origin;
+		Vector<N, T> edge1;
+		Vector<N, T> edge2;
+		Vector<N, T> normal;
+	};
+
 	template<int N, typename T>
-	class Mesh : private MeshData<Point<N, T>, Point<3, Point<N, T> const*>>
+	class Mesh : private MeshData<Point<N, T>, IndexTriangle<uint32_t>>
 	{
 	public:
 
-		using MeshData = MeshData<Point<N, T>, Point<3, Point<N, T> const*>>;
+		using MeshData = MeshData<Point<N, T>, IndexTriangle<uint32_t>>;
+		using Index = typename MeshData::Triangle::Index;
+
+		static_assert(std::is_trivially_copyable_v<typename MeshData::Triangle>);
+		using Hierarchy = WideBVH<N, T>;
+		using LazyHierarchy = LazyBVH<N, T>;
+		using Record = TriangleRecord<N, T>;
 
 		constexpr Mesh() noexcept = default;
 
@@ -56,19 +86,9 @@ namespace JL
 		constexpr Mesh(Mesh&&) noexcept = default;
 		constexpr Mesh& operator = (Mesh&&) noexcept = default;
 
-		explicit Mesh(Mesh const& other)
-			: MeshData{ other.vertices }
-		{
-			MeshData::center = other.center;
-			CopyTriangles(other, std::make_index_sequence<3>{});
-		}
-
-		Mesh& operator = (Mesh const& other)
-		{
-			MeshData::vertices = other.vertices;
-			MeshData::center = other.center;
-			CopyTriangles(other, std::make_index_sequence<3>{});
-		}
+		// Triangles index into the vertices, copies need no fixing up
+		explicit Mesh(Mesh const&) = default;
+		Mesh& operator = (Mesh const&) = default;
 
 		//static constexpr Mesh const& AsMesh(MeshData const& data)
 		//{
@@ -97,6 +117,101 @@ namespace JL
 			return MeshData::triangles;
 		}
 
+		constexpr auto const& GetCenter() const noexcept
+		{
+			return MeshData::center;
+		}
+
+		// One per triangle, in the same order
+		constexpr auto const& GetRecords() const noexcept
+		{
+			return m_Records;
+		}
+
+		// Empty while the mesh is lazy
+		constexpr Hierarchy const& GetHierarchy() const noexcept
+		{
+			return m_Hierarchy;
+		}
+
+		constexpr LazyHierarchy const& GetLazyHierarchy() const noexcept
+		{
+			return m_Lazy;
+		}
+
+		// Traced through the lazy hierarchy instead of the full one
+		bool IsLazy() const noexcept
+		{
+			return !m_Lazy.IsEmpty();
+		}
+
+		// Bakes the triangle records and builds the hierarchy over them.
+		// Has to be called after editing the data through AsData()
+		void BuildHierarchy()
+		{
+			m_Rebuild = {};
+			m_Lazy.Clear();
+			m_Hierarchy.Build(Bake());
+		}
+
+		// Like BuildHierarchy, but only bakes the records and leaves splitting to the rays that reach the triangles.
+		// The mesh can be traced much sooner, and the lazy hierarchy stays in use until BuildHierarchy or Restore
+		void BuildLazyHierarchy()
+		{
+			m_Rebuild = {};
+			m_Hierarchy.Clear();
+			m_Lazy.Build(Bake());
+		}
+
+		// Takes records and a hierarchy baked and built before for the current vertices and triangles, as stored by a mesh cache.
+		// Returns false when they do not match the triangles, the mesh is left without records or hierarchy then.
+		bool Restore(std::vector<Record> records, std::vector<typename Hierarchy::Node> nodes, std::vector<typename Hierarchy::Index> indices)
+		{
+			m_Rebuild = {};
+			m_Lazy.Clear();
+			m_Records = std::move(records);
+			const auto count{ static_cast<typename Hierarchy::Index>(MeshData::triangles.size()) };
+			if (m_Records.size() == count && m_Hierarchy.Restore(std::move(nodes), std::move(indices), count))
+				return true;
+			m_Records.clear();
+			m_Hierarchy.Clear();
+			return false;
+		}
+
+		// Bakes the triangle records and refits the hierarchy to them, for vertices that moved but triangles that stayed the same.
+		// Once the refitted hierarchy got too slow to traverse, a new one is built in the background.
+		// It replaces the refitted one at a later refit, as soon as it is done.
+		// A lazy hierarchy starts over instead, that costs no more than baking
+		void RefitHierarchy()
+		{
+			if (IsLazy())
+			{
+				m_Lazy.Build(Bake());
+				return;
+			}
+
+			if (m_Rebuild.valid() && m_Rebuild.wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready)
+			{
+				// built over older vertices, the same triangles. The refit below brings it up to date
+				m_Hierarchy = m_Rebuild.get();
+				m_Rebuild = {};
+			}
+
+			std::vector<Box<N, T>> bounds{ Bake() };
+			if (m_Hierarchy.Refit(bounds) > REBUILD_DEGRADATION && !m_Rebuild.valid())
+			{
+				m_Rebuild = std::async(
+					std::launch::async,
+					[bounds{ std::move(bounds) }]()
+					{
+						Hierarchy hierarchy{};
+						hierarchy.Build(bounds);
+						return hierarchy;
+					}
+				).share();
+			}
+		}
+
 		auto begin() const noexcept
 		{
 			return MeshData::triangles.cbegin();
@@ -112,6 +227,10 @@ namespace JL
 			for (auto& vertice : MeshData::vertices)
 				vertice += translation;
 			MeshData::center += translation;
+			for (Record& record : m_Records)
+				record.origin += translation;
+			m_Hierarchy.Translate(translation);
+			m_Lazy.Translate(translation);
 		}
 
 		void Scale(T const& scale)
@@ -119,6 +238,7 @@ namespace JL
 			for (auto& vertice : MeshData::vertices)
 				vertice *= scale;
 			MeshData::center *= scale;
+			RefitHierarchy();
 		}
 
 		void Scale(Vector<N, T> const& scale)
@@ -126,6 +246,7 @@ namespace JL
 			for (auto& vertice : MeshData::vertices)
 				JL::Scale(vertice, scale);
 			JL::Scale(MeshData::center, scale);
+			RefitHierarchy();
 		}
 
 		template<int D> 
@@ -144,6 +265,7 @@ namespace JL
 				vertice *= transformation;
 				vertice += move;
 			}
+			RefitHierarchy();
 		}
 
 		void ResetCenter()
@@ -162,12 +284,36 @@ namespace JL
 
 	private:
 
-		template<size_t ... INDECES>
-		void CopyTriangles(Mesh const& other, std::index_sequence<INDECES...>)
+		std::vector<Record> m_Records;
+		Hierarchy m_Hierarchy;
+		LazyHierarchy m_Lazy; // empty unless the mesh is lazy
+		std::shared_future<Hierarchy> m_Rebuild; // copies share it, they have the same triangles
+
+		// Rebuild once traversal is expected to be this much slower than right after building
+		static constexpr T REBUILD_DEGRADATION = static_cast<T>(1.5);
+
+		// Bakes the record of every triangle and returns their bounds
+		std::vector<Box<N, T>> Bake()
 		{
-			ptrdiff_t const diff{ MeshData::vertices.data() - other.vertices.data() };
-			for (auto const& triangle : other.triangles)
-				MeshData::triangles.emplace_back( (triangle.data[INDECES] + diff) ... );
+			std::vector<Box<N, T>> bounds{};
+			bounds.reserve(MeshData::triangles.size());
+			m_Records.clear();
+			m_Records.reserve(MeshData::triangles.size());
+			for (auto const& triangle : MeshData::triangles)
+			{
+				Box<N, T> box{};
+				auto const& a{ MeshData::vertices[triangle.x] };
+				auto const& b{ MeshData::vertices[triangle.y] };
+				auto const& c{ MeshData::vertices[triangle.z] };
+
+				box.Grow(a).Grow(b).Grow(c);
+				bounds.push_back(box);
+
+				Vector<N, T> const edge1{ b - a };
+				Vector<N, T> const edge2{ c - a };
+				m_Records.push_back(Record{ a, edge1, edge2, Cross(edge1, edge2) });
+			}
+			return bounds;
 		}
 
 	};
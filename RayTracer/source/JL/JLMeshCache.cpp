@@ -0,0 +1,224 @@
+#include "JLMeshCache.h"
+#include "JLMappedFile.h"
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+
+namespace JL
+{
+
+	namespace
+	{
+
+		using Vertex = Mesh_t::MeshData::Vertex;
+		using Triangle = Mesh_t::MeshData::Triangle;
+		using Record = Mesh_t::Record;
+		using Node = Mesh_t::Hierarchy::Node;
+		using Index = Mesh_t::Hierarchy::Index;
+
+		// Increase whenever the layout of the file or of anything stored in it changes
+		constexpr uint32_t VERSION{ 2 };
+		constexpr char MAGIC[8]{ "JLMESH" };
+		constexpr uint32_t ENDIANNESS{ 0x01020304 };
+		constexpr size_t ALIGNMENT{ 64 };
+
+		enum Section : size_t
+		{
+			VERTICES,
+			TRIANGLES,
+			RECORDS,
+			NODES,
+			INDICES,
+			SECTIONS
+		};
+
+		constexpr uint32_t ELEMENT_SIZES[SECTIONS]{ sizeof(Vertex), sizeof(Triangle), sizeof(Record), sizeof(Node), sizeof(Index) };
+
+		struct Header
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t byteOrder;
+			uint32_t elementSizes[SECTIONS]; // the layout the sections were written with
+			uint64_t sourceSize;
+			int64_t sourceTime;
+			uint64_t sourceHash;
+			uint64_t counts[SECTIONS];
+			uint64_t offsets[SECTIONS]; // from the start of the file, aligned
+			float center[3];
+		};
+
+		struct Source
+		{
+			uint64_t size;
+			int64_t time;
+		};
+
+		bool GetSource(Source& source, std::string_view sourcePath)
+		{
+			std::error_code error{};
+			const std::filesystem::path path{ sourcePath };
+			const auto size{ std::filesystem::file_size(path, error) };
+			if (error)
+				return false;
+			const auto time{ std::filesystem::last_write_time(path, error) };
+			if (error)
+				return false;
+			source = Source{ static_cast<uint64_t>(size), static_cast<int64_t>(time.time_since_epoch().count()) };
+			return true;
+		}
+
+		// FNV-1a
+		bool HashSource(uint64_t& hash, std::string_view sourcePath)
+		{
+			const MappedFile file{ std::string{ sourcePath } };
+			if (!file.IsOpen())
+				return false;
+			hash = 0xcbf29ce484222325ull;
+			for (char c : file.GetText())
+				hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+			return true;
+		}
+
+		constexpr uint64_t Align(uint64_t offset) noexcept
+		{
+			return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		}
+
+		template<typename Element>
+		void Copy(std::vector<Element>& result, std::string_view file, Header const& header, Section section)
+		{
+			result.resize(static_cast<size_t>(header.counts[section]));
+			if (!result.empty())
+				std::memcpy(static_cast<void*>(result.data()), file.data() + header.offsets[section], result.size() * sizeof(Element));
+		}
+
+	}
+
+	std::string GetMeshCachePath(std::string_view sourcePath)
+	{
+		return std::string{ sourcePath } + MESH_CACHE_EXTENSION;
+	}
+
+	bool LoadMeshCache(Mesh_t& mesh, std::string_view sourcePath)
+	{
+		Source source{};
+		if (!GetSource(source, sourcePath))
+			return false;
+
+		const MappedFile file{ GetMeshCachePath(sourcePath) };
+		const std::string_view data{ file.GetText() };
+		if (!file.IsOpen() || data.size() < sizeof(Header))
+			return false;
+
+		Header header{};
+		std::memcpy(&header, data.data(), sizeof(Header));
+		if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.byteOrder != ENDIANNESS
+			|| std::memcmp(header.elementSizes, ELEMENT_SIZES, sizeof(ELEMENT_SIZES)) != 0)
+			return false;
+
+		for (size_t section{}; section < SECTIONS; ++section)
+			if (header.offsets[section] > data.size() || header.counts[section] > (data.size() - header.offsets[section]) / ELEMENT_SIZES[section])
+				return false;
+
+		// Stale when the source changed since. Only hash it when its size matches but the time does not
+		if (header.sourceSize != source.size)
+			return false;
+		if (header.sourceTime != source.time)
+		{
+			uint64_t hash{};
+			if (!HashSource(hash, sourcePath) || hash != header.sourceHash)
+				return false;
+		}
+
+		Mesh_t loaded{};
+		auto& meshData{ loaded.AsData() };
+		Copy(meshData.vertices, data, header, VERTICES);
+		Copy(meshData.triangles, data, header, TRIANGLES);
+		for (Triangle const& triangle : meshData.triangles)
+			if (triangle.x >= meshData.vertices.size() || triangle.y >= meshData.vertices.size() || triangle.z >= meshData.vertices.size())
+				return false;
+		loaded.SetCenter(Vertex{ header.center[0], header.center[1], header.center[2] });
+
+		std::vector<Record> records{};
+		std::vector<Node> nodes{};
+		std::vector<Index> indices{};
+		Copy(records, data, header, RECORDS);
+		Copy(nodes, data, header, NODES);
+		Copy(indices, data, header, INDICES);
+		if (!loaded.Restore(std::move(records), std::move(nodes), std::move(indices)))
+			return false;
+
+		mesh = std::move(loaded);
+		return true;
+	}
+
+	bool WriteMeshCache(Mesh_t const& mesh, std::string_view sourcePath)
+	{
+		Header header{};
+		std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = VERSION;
+		header.byteOrder = ENDIANNESS;
+		std::memcpy(header.elementSizes, ELEMENT_SIZES, sizeof(ELEMENT_SIZES));
+
+		Source source{};
+		if (!GetSource(source, sourcePath) || !HashSource(header.sourceHash, sourcePath))
+			return false;
+		header.sourceSize = source.size;
+		header.sourceTime = source.time;
+
+		void const* const sections[SECTIONS]{
+			mesh.GetVertices().data(),
+			mesh.GetTriangles().data(),
+			mesh.GetRecords().data(),
+			mesh.GetHierarchy().GetNodes().data(),
+			mesh.GetHierarchy().GetIndices().data()
+		};
+		header.counts[VERTICES] = mesh.GetVertices().size();
+		header.counts[TRIANGLES] = mesh.GetTriangles().size();
+		header.counts[RECORDS] = mesh.GetRecords().size();
+		header.counts[NODES] = mesh.GetHierarchy().GetNodes().size();
+		header.counts[INDICES] = mesh.GetHierarchy().GetIndices().size();
+
+		uint64_t offset{ sizeof(Header) };
+		for (size_t section{}; section < SECTIONS; ++section)
+		{
+			header.offsets[section] = offset = Align(offset);
+			offset += header.counts[section] * ELEMENT_SIZES[section];
+		}
+
+		Vertex const& center{ mesh.GetCenter() };
+		header.center[0] = center.x;
+		header.center[1] = center.y;
+		header.center[2] = center.z;
+
+		// Written aside and renamed once complete, so a cache is never read half written
+		const std::string path{ GetMeshCachePath(sourcePath) };
+		const std::string temporary{ path + ".tmp" };
+		bool written{};
+		{
+			std::ofstream file{ temporary, std::ios::out | std::ios::binary | std::ios::trunc };
+			file.write(reinterpret_cast<char const*>(&header), sizeof(Header));
+			uint64_t position{ sizeof(Header) };
+			for (size_t section{}; section < SECTIONS && file; ++section)
+			{
+				static constexpr char padding[ALIGNMENT]{};
+				const uint64_t size{ header.counts[section] * ELEMENT_SIZES[section] };
+				file.write(padding, static_cast<std::streamsize>(header.offsets[section] - position));
+				file.write(static_cast<char const*>(sections[section]), static_cast<std::streamsize>(size));
+				position = header.offsets[section] + size;
+			}
+			written = bool(file);
+		}
+
+		std::error_code error{};
+		if (written)
+			std::filesystem::rename(temporary, path, error);
+		if (written && !error)
+			return true;
+		std::filesystem::remove(temporary, error);
+		return false;
+	}
+
+}
@@ -0,0 +1,46 @@
+// MeshCache.h - Binary mesh files holding the baked triangles and hierarchy, loaded without parsing.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include <string>
+#include <string_view>
+#include "JLMeshConstruct.h"
+
+namespace JL
+{
+
+	// A cache file is written next to the source it was loaded from. It holds the vertices, triangles,
+	// baked triangle records and hierarchy nodes in the layout they have in memory, each section copied straight out of the mapped file.
+	// It is keyed by the source's size, modification time and content hash: a cache is only used for the source as it was when written.
+	// Sources that only got a new modification time are hashed to tell whether their contents changed.
+
+	constexpr char MESH_CACHE_EXTENSION[]{ ".jlmesh" };
+
+	std::string GetMeshCachePath(std::string_view sourcePath);
+
+	// Returns false when there is no cache for the source as it is now, or it was written by another version. The mesh is left as it was then
+	bool LoadMeshCache(Mesh_t& mesh, std::string_view sourcePath);
+
+	// Returns false when the source or the cache file could not be accessed
+	bool WriteMeshCache(Mesh_t const& mesh, std::string_view sourcePath);
+
+}
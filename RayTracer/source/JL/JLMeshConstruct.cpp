@@ -1,5 +1,5 @@
 #include "JLMeshConstruct.h"
-#include <fstream>
+#include "JLMeshCache.h"
 
 namespace JL
 {
@@ -16,33 +16,41 @@ namespace JL
 		return reinterpret_cast<Mesh_t::MeshData::Container<Mesh_t::MeshData::Vertex>&>(vertex);
 	}
 
-	Mesh_t::MeshData::Triangle& AsMeshTriangle(OBJ::Face& face) noexcept
+	bool LoadMesh(Mesh_t& mesh, std::string_view filePath, bool lazy)
 	{
-		static_assert(sizeof(Mesh_t::MeshData::Triangle) == sizeof(OBJ::Face));
-		return reinterpret_cast<Mesh_t::MeshData::Triangle&>(face);
-	}
 
-	Mesh_t::MeshData::Container<Mesh_t::MeshData::Triangle>& AsMeshTriangleVector(decltype(OBJ::faces)& vertex) noexcept
-	{
-		static_assert(sizeof(Mesh_t::MeshData::Container<Mesh_t::MeshData::Triangle>) == sizeof(decltype(OBJ::faces)));
-		return reinterpret_cast<Mesh_t::MeshData::Container<Mesh_t::MeshData::Triangle>&>(vertex);
-	}
-
-	void LoadMesh(Mesh_t& mesh, std::string_view filePath)
-	{
+		if (LoadMeshCache(mesh, filePath))
+			return true;
 
 		//This only works when the OBJ and Mesh have the same point structure. Which they do in my case.
 
-		std::ifstream file{ filePath.data(), std::ios::in };
-
 		OBJ objData;
-		file >> objData;
+		if (!LoadOBJ(objData, filePath))
+			return false;
+
+		auto& triangles{ mesh.AsData().triangles };
+		triangles.clear();
+		triangles.reserve(objData.faces.size());
+		for (OBJ::Face const& face : objData.faces)
+			triangles.push_back({
+				static_cast<Mesh_t::Index>(face.a),
+				static_cast<Mesh_t::Index>(face.b),
+				static_cast<Mesh_t::Index>(face.c)
+			});
 
 		mesh.AsData().vertices = std::move(AsMeshVertexVector(objData.vertices));
-		mesh.AsData().triangles = std::move(AsMeshTriangleVector(objData.faces));
 
 		mesh.ResetCenter();
+		if (lazy)
+		{
+			mesh.BuildLazyHierarchy();
+			return true; // the cache holds a full hierarchy
+		}
+		mesh.BuildHierarchy();
+
+		WriteMeshCache(mesh, filePath); // the next load can skip all of the above
 
+		return true;
 	}
 
 }
\ No newline at end of file
@@ -31,6 +31,9 @@ namespace JL
 
 	using Mesh_t = Mesh<OBJ::Vertex::SIZE, OBJ::Vertex::type>;
 
-	void LoadMesh(Mesh_t& mesh, std::string_view filePath);
+	// Loads from the file's mesh cache when it is up to date, otherwise parses the file and writes the cache.
+	// With lazy, a parsed mesh gets a lazy hierarchy instead, so it can be traced right away. No cache is written for it then.
+	// Returns false when the file could not be read or parsed, the mesh is left as it was then
+	bool LoadMesh(Mesh_t& mesh, std::string_view filePath, bool lazy = false);
 
 }
\ No newline at end of file
@@ -0,0 +1,142 @@
+// MeshInstance.h - Shared mesh geometry placed in the world by its own transformation
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include "JLBaseIncludes.h"
+#include "JLBox.h"
+#include "JLLine.h"
+#include "JLMesh.h"
+#include <memory>
+
+namespace JL
+{
+
+	// References mesh geometry (vertices, triangle records and hierarchy) shared by any number of instances.
+	// The instance only holds the object to world transformation: world = linear * object + translation.
+	// Moving, rotating or copying an instance never touches the geometry, rays are brought into object space instead.
+	template<int N, typename T>
+	class MeshInstance
+	{
+	public:
+
+		using Mesh = Mesh<N, T>;
+		using Transformation = Matrix<N, N, T>;
+
+		MeshInstance() noexcept = default;
+
+		explicit MeshInstance(std::shared_ptr<Mesh const> pMesh, Vector<N, T> const& translation = {})
+			: m_pMesh{ std::move(pMesh) }
+			, m_Translation{ translation }
+		{}
+
+		Mesh const& GetMesh() const noexcept
+		{
+			return *m_pMesh;
+		}
+
+		std::shared_ptr<Mesh const> const& GetSharedMesh() const noexcept
+		{
+			return m_pMesh;
+		}
+
+		Transformation const& GetLinear() const noexcept
+		{
+			return m_Linear;
+		}
+
+		Transformation const& GetInverse() const noexcept
+		{
+			return m_Inverse;
+		}
+
+		Vector<N, T> const& GetTranslation() const noexcept
+		{
+			return m_Translation;
+		}
+
+		// The mesh center, in world space
+		Point<N, T> GetCenter() const
+		{
+			return ToWorld(m_pMesh->GetCenter());
+		}
+
+		void Translate(Vector<N, T> const& translation) noexcept
+		{
+			m_Translation += translation;
+		}
+
+		// Transforms the instance about its world center, as Mesh::Transform does about the mesh center
+		void Transform(Transformation const& transformation)
+		{
+			Transform(transformation, GetCenter());
+		}
+
+		void Transform(Transformation const& transformation, Point<N, T> const& pivot)
+		{
+			Vector<N, T> const move{ pivot };
+			m_Linear = transformation * m_Linear;
+			m_Inverse = Inverse(m_Linear);
+			m_Translation = transformation * (m_Translation - move) + move;
+		}
+
+		Point<N, T> ToWorld(Point<N, T> const& point) const
+		{
+			return Point<N, T>{ m_Linear * Vector<N, T>{ point } + m_Translation };
+		}
+
+		Vector<N, T> ToWorld(Vector<N, T> const& vector) const
+		{
+			return m_Linear * vector;
+		}
+
+		Point<N, T> ToObject(Point<N, T> const& point) const
+		{
+			return Point<N, T>{ m_Inverse * (Vector<N, T>{ point } - m_Translation) };
+		}
+
+		Vector<N, T> ToObject(Vector<N, T> const& vector) const
+		{
+			return m_Inverse * vector;
+		}
+
+		// Normals transform with the inverse transpose, so they stay perpendicular under non uniform scaling
+		Vector<N, T> NormalToWorld(Vector<N, T> const& normal) const
+		{
+			return Transpose(m_Inverse) * normal;
+		}
+
+		// The direction is not normalized, distances along the line are the same in both spaces
+		Line<N, T> ToObject(Line<N, T> const& line) const
+		{
+			return Line<N, T>{ ToObject(line.origin), ToObject(line.direction) };
+		}
+
+	private:
+
+		std::shared_ptr<Mesh const> m_pMesh;
+		Transformation m_Linear{ Transformation::Identity() };
+		Transformation m_Inverse{ Transformation::Identity() };
+		Vector<N, T> m_Translation{};
+
+	};
+
+}
@@ -0,0 +1,312 @@
+#include "JLOBJ.h"
+#include "JLMappedFile.h"
+#include <charconv>
+#include <future>
+#include <thread>
+#include <iterator>
+#include <algorithm>
+#include <string>
+
+namespace JL
+{
+
+	namespace
+	{
+
+		using Index = OBJ::Face::type;
+
+		// Negative indices count back from the last vertex read so far. A chunk does not know how many vertices the chunks before it hold,
+		// so it stores them marked as relative, as an offset from its own first vertex (biased to stay positive, never reaching NONE).
+		// They are made absolute once every chunk is done.
+		constexpr Index RELATIVE{ Index{ 1 } << (sizeof(Index) * 8 - 1) };
+		constexpr long long BIAS{ RELATIVE / 2 };
+
+		constexpr size_t MIN_CHUNK_SIZE{ 1 << 20 }; // bytes, smaller texts are parsed on the calling thread
+
+		struct Chunk
+		{
+			std::vector<OBJ::Vertex> vertices;
+			std::vector<OBJ::Normal> normals;
+			std::vector<OBJ::Face> faces;
+		};
+
+		class Parser
+		{
+		public:
+
+			Parser(char const* first, char const* last, Chunk& chunk) noexcept
+				: m_pCurrent{ first }
+				, m_pEnd{ last }
+				, m_Chunk{ chunk }
+			{}
+
+			bool Parse()
+			{
+				while (m_pCurrent != m_pEnd)
+				{
+					SkipBlanks();
+					const std::string_view keyword{ Word() };
+					bool valid{ true };
+					if (keyword == OBJ::Vertex::NAME)
+						valid = ReadValues(m_Chunk.vertices.emplace_back());
+					else if (keyword == OBJ::Normal::NAME)
+						valid = ReadValues(m_Chunk.normals.emplace_back());
+					else if (keyword == OBJ::Face::NAME)
+						valid = ReadFace();
+					if (!valid)
+						return false;
+					SkipLine(); // comments, trailing values and unsupported statements
+				}
+				return true;
+			}
+
+		private:
+
+			char const* m_pCurrent;
+			char const* m_pEnd;
+			Chunk& m_Chunk;
+
+			void SkipBlanks() noexcept
+			{
+				while (m_pCurrent != m_pEnd && (*m_pCurrent == ' ' || *m_pCurrent == '\t' || *m_pCurrent == '\r'))
+					++m_pCurrent;
+			}
+
+			void SkipLine() noexcept
+			{
+				m_pCurrent = std::find(m_pCurrent, m_pEnd, '\n');
+				if (m_pCurrent != m_pEnd)
+					++m_pCurrent;
+			}
+
+			bool AtLineEnd() noexcept
+			{
+				SkipBlanks();
+				return m_pCurrent == m_pEnd || *m_pCurrent == '\n' || *m_pCurrent == '#';
+			}
+
+			std::string_view Word() noexcept
+			{
+				char const* const first{ m_pCurrent };
+				while (m_pCurrent != m_pEnd && *m_pCurrent != ' ' && *m_pCurrent != '\t' && *m_pCurrent != '\r' && *m_pCurrent != '\n')
+					++m_pCurrent;
+				return { first, static_cast<size_t>(m_pCurrent - first) };
+			}
+
+			template<typename Value>
+			bool ReadNumber(Value& value) noexcept
+			{
+				SkipBlanks();
+				if (m_pCurrent != m_pEnd && *m_pCurrent == '+') // from_chars only takes a minus sign
+					++m_pCurrent;
+				auto const [end, error] { std::from_chars(m_pCurrent, m_pEnd, value) };
+				m_pCurrent = end;
+				return error == std::errc{};
+			}
+
+			template<typename Object>
+			bool ReadValues(Object& object) noexcept
+			{
+				for (auto& value : object.data)
+					if (!ReadNumber(value))
+						return false;
+				return true;
+			}
+
+			// One based, or negative to count back from the last one read. Zero is not an index
+			static bool Resolve(Index& result, long long index, size_t count) noexcept
+			{
+				const long long offset{ static_cast<long long>(count) + index };
+				if (index > 0 && index <= static_cast<long long>(RELATIVE))
+					result = static_cast<Index>(index - 1);
+				else if (index < 0 && offset >= -BIAS && offset < BIAS - 1)
+					result = static_cast<Index>(offset + BIAS) | RELATIVE;
+				else
+					return false;
+				return true;
+			}
+
+			// v, v/vt, v/vt/vn or v//vn
+			bool ReadCorner(Index& vertex, Index& normal) noexcept
+			{
+				long long index{};
+				if (!ReadNumber(index) || !Resolve(vertex, index, m_Chunk.vertices.size()))
+					return false;
+
+				normal = OBJ::Face::NONE;
+				if (m_pCurrent == m_pEnd || *m_pCurrent != '/')
+					return true;
+				++m_pCurrent;
+				if (m_pCurrent != m_pEnd && *m_pCurrent != '/' && !ReadNumber(index)) // texture coordinates are not used
+					return false;
+				if (m_pCurrent == m_pEnd || *m_pCurrent != '/')
+					return true;
+				++m_pCurrent;
+				return ReadNumber(index) && Resolve(normal, index, m_Chunk.normals.size());
+			}
+
+			// Polygons become a fan of triangles around their first corner
+			bool ReadFace()
+			{
+				Index vertices[3]{}, normals[3]{};
+				int corners{};
+				while (!AtLineEnd())
+				{
+					const int corner{ std::min(corners, 2) };
+					if (!ReadCorner(vertices[corner], normals[corner]))
+						return false;
+					if (++corners >= 3)
+					{
+						OBJ::Face& face{ m_Chunk.faces.emplace_back() };
+						std::copy(std::begin(vertices), std::end(vertices), std::begin(face.vertices));
+						std::copy(std::begin(normals), std::end(normals), std::begin(face.normals));
+						vertices[1] = vertices[2];
+						normals[1] = normals[2];
+					}
+				}
+				return corners >= 3;
+			}
+
+		};
+
+		// Splits the text at line ends into about equal chunks, one per hardware thread
+		std::vector<std::string_view> Split(std::string_view text)
+		{
+			const size_t count{ std::clamp<size_t>(text.size() / MIN_CHUNK_SIZE, 1, std::max(1u, std::thread::hardware_concurrency())) };
+			std::vector<std::string_view> chunks{};
+			chunks.reserve(count);
+			size_t first{};
+			for (size_t chunk{ 1 }; chunk <= count; ++chunk)
+			{
+				size_t last{ text.size() * chunk / count };
+				last = last < text.size() ? std::min(text.find('\n', last), text.size() - 1) + 1 : text.size();
+				if (last > first)
+					chunks.push_back(text.substr(first, last - first));
+				first = std::max(first, last);
+			}
+			return chunks;
+		}
+
+		// Makes the chunk's indices absolute and moves its contents into obj at the given offsets
+		bool Gather(OBJ& obj, Chunk& chunk, size_t vertexBase, size_t normalBase, size_t faceBase)
+		{
+			auto const absolute = [](Index& index, size_t base, size_t count) -> bool
+			{
+				if (index & RELATIVE)
+				{
+					const long long offset{ static_cast<long long>(index & ~RELATIVE) - BIAS + static_cast<long long>(base) };
+					if (offset < 0)
+						return false;
+					index = static_cast<Index>(offset);
+				}
+				return index < count;
+			};
+
+			for (OBJ::Face& face : chunk.faces)
+			{
+				for (unsigned corner{}; corner < OBJ::Face::SIZE; ++corner)
+				{
+					if (!absolute(face.vertices[corner], vertexBase, obj.vertices.size()))
+						return false;
+					if (face.normals[corner] != OBJ::Face::NONE && !absolute(face.normals[corner], normalBase, obj.normals.size()))
+						return false;
+				}
+			}
+
+			std::copy(chunk.vertices.begin(), chunk.vertices.end(), obj.vertices.begin() + vertexBase);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), obj.normals.begin() + normalBase);
+			std::copy(chunk.faces.begin(), chunk.faces.end(), obj.faces.begin() + faceBase);
+			return true;
+		}
+
+		// Runs function(index) for every index, on its own thread unless there is only one
+		template<typename Function>
+		bool ForEachChunk(size_t count, Function const& function)
+		{
+			if (count == 1)
+				return function(0);
+
+			std::vector<std::future<bool>> jobs{};
+			jobs.reserve(count);
+			for (size_t index{}; index < count; ++index)
+				jobs.push_back(std::async(std::launch::async, function, index));
+			bool success{ true };
+			for (auto& job : jobs)
+				success &= job.get();
+			return success;
+		}
+
+	}
+
+	bool ParseOBJ(OBJ& obj, std::string_view text)
+	{
+		obj.vertices.clear();
+		obj.normals.clear();
+		obj.faces.clear();
+
+		const std::vector<std::string_view> texts{ Split(text) };
+		std::vector<Chunk> chunks(texts.size());
+
+		const bool parsed{ ForEachChunk(
+			chunks.size(),
+			[&texts, &chunks](size_t index)
+			{
+				Chunk& chunk{ chunks[index] };
+				const size_t estimate{ texts[index].size() / 32 }; // lines in a typical file are around this long
+				chunk.vertices.reserve(estimate / 2);
+				chunk.faces.reserve(estimate);
+				return Parser{ texts[index].data(), texts[index].data() + texts[index].size(), chunk }.Parse();
+			}
+		) };
+
+		// Every chunk's place in the whole
+
+		std::vector<size_t> vertexBases(chunks.size() + 1);
+		std::vector<size_t> normalBases(chunks.size() + 1);
+		std::vector<size_t> faceBases(chunks.size() + 1);
+		for (size_t index{}; index < chunks.size(); ++index)
+		{
+			vertexBases[index + 1] = vertexBases[index] + chunks[index].vertices.size();
+			normalBases[index + 1] = normalBases[index] + chunks[index].normals.size();
+			faceBases[index + 1] = faceBases[index] + chunks[index].faces.size();
+		}
+
+		if (parsed)
+		{
+			obj.vertices.resize(vertexBases.back());
+			obj.normals.resize(normalBases.back());
+			obj.faces.resize(faceBases.back());
+
+			const bool gathered{ ForEachChunk(
+				chunks.size(),
+				[&obj, &chunks, &vertexBases, &normalBases, &faceBases](size_t index)
+				{
+					return Gather(obj, chunks[index], vertexBases[index], normalBases[index], faceBases[index]);
+				}
+			) };
+
+			if (gathered)
+				return true;
+		}
+
+		obj.vertices.clear();
+		obj.normals.clear();
+		obj.faces.clear();
+		return false;
+	}
+
+	bool LoadOBJ(OBJ& obj, std::string_view filePath)
+	{
+		const MappedFile file{ std::string{ filePath } };
+		return file.IsOpen() && ParseOBJ(obj, file.GetText());
+	}
+
+	std::istream& operator >> (std::istream& is, OBJ& obj)
+	{
+		const std::string text{ std::istreambuf_iterator<char>{ is }, std::istreambuf_iterator<char>{} };
+		if (!ParseOBJ(obj, text))
+			is.setstate(std::ios::failbit);
+		return is;
+	}
+
+}
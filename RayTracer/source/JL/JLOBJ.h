@@ -23,12 +23,14 @@
 #pragma once
 #include <vector>
 #include <iostream>
-#include <utility>
-#include "JLReadFromIstream.h"
+#include <string_view>
+#include <cstdint>
 
 namespace JL
 {
 
+	// Vertices, normals and triangles of an .obj file.
+	// Polygons are split into triangle fans, texture coordinates and everything else is skipped.
 	struct OBJ
 	{
 		OBJ() = default;
@@ -51,17 +53,20 @@ namespace JL
 			static constexpr char NAME[3]{ "vn" };
 		};
 
+		// Zero based indices, negative (relative) indices in the file are already resolved
 		struct Face
 		{
 			static constexpr char NAME[2]{ "f" };
 			static constexpr unsigned SIZE = 3;
-			using type = Vertex*;
+			using type = uint32_t;
+			static constexpr type NONE = ~type{}; // the corner has no normal
 			union
 			{
 				type data[SIZE];
 				type vertices[SIZE];
 				struct { type a, b, c; };
 			};
+			type normals[SIZE];
 		};
 
 		std::vector<Vertex> vertices;
@@ -74,38 +79,15 @@ namespace JL
 		OBJ& operator = (OBJ&&) = delete;
 	};
 
-	template<typename Char, typename Object, typename ReadType = typename Object::type, typename = std::enable_if_t<(sizeof(typename Object::type) >= sizeof(ReadType))>>
-	std::basic_istream<Char>& Read(std::basic_istream<Char>& is, Object& object)
-	{
-		auto read = [&is, &object]()
-		{
-			if constexpr (!std::is_same<typename Object::type, ReadType>::value)
-			{
-				object.data[0] = reinterpret_cast<typename Object::type>(Read<ReadType>(is));
-				object.data[1] = reinterpret_cast<typename Object::type>(Read<ReadType>(is));
-				object.data[2] = reinterpret_cast<typename Object::type>(Read<ReadType>(is));
-			}
-			else
-			{
-				Read<ReadType>(is, object.data[0]);
-				Read<ReadType>(is, object.data[1]);
-				Read<ReadType>(is, object.data[2]);
-			}
-		};
-		try
-		{
-			read();
-		}
-		catch (const std::invalid_argument&)
-		{
-			bool correct{ true };
-			for (const char* c{ object.NAME }; *c != '\0'; ++c)
-				correct &= (Read<Char>(is) == static_cast<Char>(*c));
-			if (correct)
-				Read<Char>(is), read();
-		}
-		return is;
-	}
+	// Replaces the contents of obj with those of obj text. Large texts are parsed in chunks concurrently.
+	// Returns false for malformed text or indices out of range, obj is left empty then.
+	bool ParseOBJ(OBJ& obj, std::string_view text);
+
+	// Maps the file into memory and parses it. Returns false when it can not be read or parsed
+	bool LoadOBJ(OBJ& obj, std::string_view filePath);
+
+	// Reads the remainder of the stream, sets failbit when it could not be parsed
+	std::istream& operator >> (std::istream& is, OBJ& obj);
 
 	template<typename Char, typename Object>
 	std::basic_ostream<Char>& Write(std::basic_ostream<Char>& os, Object const& object)
@@ -117,24 +99,12 @@ namespace JL
 			<< object.data[2] << std::endl;
 	}
 
-	template<typename Char>
-	std::basic_istream<Char>& operator >> (std::basic_istream<Char>& is, OBJ::Vertex& vertex)
-	{
-		return Read(is, vertex);
-	}
-
 	template<typename Char>
 	std::basic_ostream<Char>& operator << (std::basic_ostream<Char>& os, OBJ::Vertex const& vertex)
 	{
 		return Write(os, vertex);
 	}
 
-	template<typename Char>
-	std::basic_istream<Char>& operator >> (std::basic_istream<Char>& is, OBJ::Normal& normal)
-	{
-		return Read(is, normal);
-	}
-
 	template<typename Char>
 	std::basic_ostream<Char>& operator << (std::basic_ostream<Char>& os, OBJ::Normal const& normal)
 	{
@@ -142,72 +112,16 @@ namespace JL
 	}
 
 	template<typename Char>
-	std::basic_istream<Char>& operator >> (std::basic_istream<Char>& is, OBJ::Face& face)
+	std::basic_ostream<Char>& operator << (std::basic_ostream<Char>& os, OBJ::Face const& face)
 	{
-		return Read<Char, OBJ::Face, int>(is, face);
-	}
-
-	template<typename = void>
-	auto AsEntry(OBJ const& obj, OBJ::Face const& face)
-	{
-		const void* zeroIndex{ obj.vertices.data() - 1 };
-		struct FaceEntry
-		{
-			int data[3];
-			const char(&NAME)[std::size(OBJ::Face::NAME)]{ OBJ::Face::NAME };
-		};
-		return FaceEntry{
-			static_cast<int>(face.a - zeroIndex),
-			static_cast<int>(face.b - zeroIndex),
-			static_cast<int>(face.c - zeroIndex)
-		};
-	}
-
-	template<typename Char>
-	std::basic_ostream<Char>& operator << (std::basic_ostream<Char>& os, std::invoke_result_t<decltype(AsEntry<>), OBJ&, OBJ::Face&> const& faceEntry)
-	{
-		return Write(os, faceEntry);
-	}
-
-	template<typename Size = int>
-	void ValidateFace(OBJ& obj, OBJ::Face& face)
-	{
-		face.data[0] = &obj.vertices.at(reinterpret_cast<Size>(face.data[0]) - 1);
-		face.data[1] = &obj.vertices.at(reinterpret_cast<Size>(face.data[1]) - 1);
-		face.data[2] = &obj.vertices.at(reinterpret_cast<Size>(face.data[2]) - 1);
-	}
-
-	template<typename Char>
-	std::basic_istream<Char>& operator >> (std::basic_istream<Char>& is, OBJ& obj)
-	{
-		while (is)
+		os << OBJ::Face::NAME;
+		for (unsigned corner{}; corner < OBJ::Face::SIZE; ++corner)
 		{
-			constexpr size_t SIZE{ 3 };
-			Char str[SIZE + 1]{};
-			is.getline(str, SIZE, ' ');
-			std::basic_string<Char> comment{};
-			if (std::strcmp(str, OBJ::Vertex::NAME) == 0)
-			{
-				obj.vertices.push_back({});
-				is >> obj.vertices.back();
-			}
-			else if (std::strcmp(str, OBJ::Normal::NAME) == 0)
-			{
-				obj.normals.push_back({});
-				is >> obj.normals.back();
-				//is.get(*str);
-			}
-			else if (std::strcmp(str, OBJ::Face::NAME) == 0)
-			{
-				obj.faces.push_back({});
-				is >> obj.faces.back();
-				//is.get(*str);
-			}
-			std::getline(is, comment, '\n');
+			os << ' ' << face.vertices[corner] + 1;
+			if (face.normals[corner] != OBJ::Face::NONE)
+				os << "//" << face.normals[corner] + 1;
 		}
-		for (OBJ::Face& face : obj.faces)
-			ValidateFace<int>(obj, face);
-		return is;
+		return os << std::endl;
 	}
 
 	template<typename Char>
@@ -218,8 +132,8 @@ namespace JL
 		for (OBJ::Normal const& normal : obj.normals)
 			os << normal;
 		for (OBJ::Face const& face : obj.faces)
-			os << AsEntry(obj, face);
+			os << face;
 		return os;
 	}
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,351 @@
+// ObjectHierarchy.h - Top level acceleration structure over the objects of a VectorTuple, compiled into flat tables.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include "JLBaseIncludes.h"
+#include "JLWideBVH.h"
+#include "JLGrid.h"
+#include "JLCalculus.h"
+#include "JLRayPacket.h"
+#include "JLAgregate.h"
+#include "JLVectorTuple.h"
+#include <vector>
+#include <tuple>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+
+namespace JL
+{
+
+	// The part of an object intersection needs: the first base of an Agregate, the object itself otherwise
+	template<typename Object>
+	struct GeometryOf { using type = Object; };
+	template<typename Geometry, typename... Rest>
+	struct GeometryOf<Agregate<Geometry, Rest...>> { using type = Geometry; };
+
+	// Geometry that holds its data in arrays of its own already (meshes, sphere sets) is referred to in the tables, anything else is copied in
+	template<typename Geometry>
+	struct IsReferenced : std::false_type {};
+	template<int N, typename T>
+	struct IsReferenced<Mesh<N, T>> : std::true_type {};
+	template<int N, typename T>
+	struct IsReferenced<SphereSet<N, T>> : std::true_type {};
+
+	// Position of Object in Objects
+	template<typename Object, typename... Objects>
+	constexpr uint32_t IndexOfType() noexcept
+	{
+		uint32_t index{};
+		bool found{};
+		((found = found || std::is_same_v<Object, Objects>, index += found ? 0 : 1), ...);
+		return index;
+	}
+
+	// Structure the bounded objects go into. A BVH traces fastest, a grid is rebuilt fastest: for scenes whose objects all move every frame
+	enum class Acceleration
+	{
+		bvh,
+		grid,
+	};
+
+	template<int N, typename T, typename Container, typename Material>
+	class ObjectHierarchy;
+
+	// The objects are compiled into flat tables: one dense table of geometry per object type, and a table of materials apart from them.
+	// Every object becomes a primitive, a 32 bit id into its geometry table and the index of its material, so traversal only touches geometry
+	// and hits only need the primitive to find their normal and material.
+	// Bounded objects go into a BVH or a grid, unbounded ones (planes) are kept in a short list that is always tested first.
+	// Objects with a bottom level structure of their own (meshes, sphere sets) traverse it from their Intersect.
+	// They are referred to rather than copied: rebuild whenever the container or its objects change.
+	template<int N, typename T, typename... Objects, typename Material>
+	class ObjectHierarchy<N, T, VectorTuple<Objects...>, Material>
+	{
+	public:
+
+		using Hierarchy = WideBVH<N, T>;
+		using Grid = Grid<N, T>;
+
+		template<typename Object>
+		using Geometry = typename GeometryOf<Object>::type;
+
+		// Geometry table of the Object type, also the type part of its primitives' ids
+		template<typename Object>
+		static constexpr uint32_t TYPE{ IndexOfType<Object, Objects...>() };
+
+		static constexpr uint32_t INDEX_BITS{ 28 };
+		static_assert(sizeof...(Objects) <= (1u << (32 - INDEX_BITS)), "Too many object types for the primitive ids");
+
+		struct Primitive
+		{
+			uint32_t id;             // geometry table in the top bits, element in it in the INDEX_BITS below
+			uint32_t material;       // into the material table
+			CullMode::Flag cullmode;
+
+			uint32_t GetType() const noexcept { return id >> INDEX_BITS; }
+			uint32_t GetIndex() const noexcept { return id & ((1u << INDEX_BITS) - 1); }
+		};
+
+		ObjectHierarchy() = default;
+
+		void Build(VectorTuple<Objects...> const& objects, Acceleration acceleration = Acceleration::bvh)
+		{
+			std::apply([](auto&... tables) { (tables.clear(), ...); }, m_Tables);
+			m_Materials.clear();
+			m_Bounded.clear();
+			m_Unbounded.clear();
+
+			std::vector<Box<N, T>> bounds{};
+			objects.ForEach(
+				[this, &bounds](auto const& object)
+				{
+					if (object.cullmode == CullMode::none)
+						return;
+
+					using Object = std::decay_t<decltype(object)>;
+					auto& table{ std::get<TYPE<Object>>(m_Tables) };
+					const Primitive primitive{ (TYPE<Object> << INDEX_BITS) | static_cast<uint32_t>(table.size()), static_cast<uint32_t>(m_Materials.size()), object.cullmode };
+
+					Geometry<Object> const& geometry{ object };
+					if constexpr (IsReferenced<Geometry<Object>>::value)
+						table.push_back(&geometry);
+					else
+						table.push_back(geometry);
+					m_Materials.push_back(static_cast<Material const&>(object));
+
+					Box<N, T> box{};
+					if (GetBounds(box, geometry))
+					{
+						bounds.push_back(box);
+						m_Bounded.push_back(primitive);
+					}
+					else
+						m_Unbounded.push_back(primitive);
+				}
+			);
+
+			// only the chosen structure is built
+			m_Acceleration = acceleration;
+			m_Hierarchy.Clear();
+			m_Grid.Clear();
+			if (acceleration == Acceleration::grid)
+				m_Grid.Build(bounds);
+			else
+				m_Hierarchy.Build(bounds, 1); // objects cost more to intersect than boxes, no subtree is merged into a leaf
+		}
+
+		Acceleration GetAcceleration() const noexcept
+		{
+			return m_Acceleration;
+		}
+
+		// Empty unless built with Acceleration::bvh
+		Hierarchy const& GetHierarchy() const noexcept
+		{
+			return m_Hierarchy;
+		}
+
+		// Empty unless built with Acceleration::grid
+		Grid const& GetGrid() const noexcept
+		{
+			return m_Grid;
+		}
+
+		template<typename Object>
+		Geometry<Object> const& GetGeometry(Primitive const& primitive) const noexcept
+		{
+			return Dereference(std::get<TYPE<Object>>(m_Tables)[primitive.GetIndex()]);
+		}
+
+		Material const& GetMaterial(Primitive const& primitive) const noexcept
+		{
+			return m_Materials[primitive.material];
+		}
+
+		// callable(geometry) on the primitive's geometry, from its table. The result type must be the same for every type of geometry
+		template<typename Callable>
+		auto Visit(Primitive const& primitive, Callable const& callable) const
+		{
+			return VisitTables(primitive, callable, std::index_sequence_for<Objects...>{});
+		}
+
+		// OriginTerm of every object for packets whose lanes all start at one point, see JL::OriginTerm
+		struct SharedOrigin
+		{
+			std::vector<T> bounded;   // in the order of the hierarchy's primitives
+			std::vector<T> unbounded;
+		};
+
+		// Recompute whenever the origin changes or the hierarchy is rebuilt
+		void Precompute(SharedOrigin& shared, Point<N, T> const& origin) const
+		{
+			auto const term = [this, &origin](Primitive const& primitive) -> T
+			{
+				return Visit(
+					primitive,
+					[&origin](auto const& geometry) -> T
+					{
+						if constexpr (HAS_ORIGIN_TERM<N, std::decay_t<decltype(geometry)>>)
+							return OriginTerm<N>(origin, geometry);
+						else
+							return T{};
+					}
+				);
+			};
+
+			shared.bounded.resize(m_Bounded.size());
+			std::transform(m_Bounded.begin(), m_Bounded.end(), shared.bounded.begin(), term);
+			shared.unbounded.resize(m_Unbounded.size());
+			std::transform(m_Unbounded.begin(), m_Unbounded.end(), shared.unbounded.begin(), term);
+		}
+
+		// callable(geometry, primitive, T& tMax) -> bool: intersect a single object, report a hit within [tMin, tMax) and shrink tMax to it.
+		// behind: search behind the line origin. tMin and tMax stay positive distances.
+		template<bool anyHit = false, bool behind = false, typename Callable>
+		bool Traverse(Line<N, T> const& line, T const& tMin, T tMax, Callable const& callable) const
+		{
+			bool found{ false };
+
+			auto visit = [this, &callable](Primitive const& primitive, T& tMax) -> bool
+			{
+				return Visit(
+					primitive,
+					[&callable, &primitive, &tMax](auto const& geometry) -> bool
+					{
+						return callable(geometry, primitive, tMax);
+					}
+				);
+			};
+
+			for (Primitive const& primitive : m_Unbounded)
+			{
+				if (visit(primitive, tMax))
+				{
+					found = true;
+					if constexpr (anyHit)
+						return true;
+				}
+			}
+
+			auto const leaf = [this, &visit](uint32_t index, T const&, T& tMax)
+			{
+				return visit(m_Bounded[index], tMax);
+			};
+
+			Line<N, T> const& searched{ behind ? Line<N, T>{ line.origin, -line.direction } : line };
+			if (m_Acceleration == Acceleration::grid)
+				found |= m_Grid.template Traverse<anyHit>(searched, tMin, tMax, leaf);
+			else
+				found |= m_Hierarchy.template Traverse<anyHit>(searched, tMin, tMax, leaf);
+
+			return found;
+		}
+
+		// Packet version: callable(geometry, primitive, Lanes& tMax, Mask active, T const* pOriginTerm) -> Mask reports the lanes hit within [tMin, tMax) and shrinks tMax for them.
+		// pShared: when every lane starts at the origin it was computed for, passed on to callable per object as pOriginTerm, else null.
+		// Looking behind is done by the caller, by reversing the packet directions.
+		template<bool anyHit = false, int W, typename Callable>
+		simd::Mask<W> Traverse(RayPacket<N, W> const& packet, simd::Lanes<W>& tMax, simd::Mask<W> active, SharedOrigin const* pShared, Callable const& callable) const
+		{
+			static_assert(std::is_same_v<T, float>, "Packets are single precision");
+			using Lanes = simd::Lanes<W>;
+			using Mask = simd::Mask<W>;
+
+			Mask found{ Mask::None() };
+
+			auto visit = [this, &callable](Primitive const& primitive, Lanes& tMax, Mask active, T const* pOriginTerm) -> Mask
+			{
+				return Visit(
+					primitive,
+					[&callable, &primitive, &tMax, active, pOriginTerm](auto const& geometry) -> Mask
+					{
+						return callable(geometry, primitive, tMax, active, pOriginTerm);
+					}
+				);
+			};
+
+			for (size_t index{}; index < m_Unbounded.size(); ++index)
+			{
+				const Mask hits{ visit(m_Unbounded[index], tMax, active, pShared ? &pShared->unbounded[index] : nullptr) };
+				found = found | hits;
+				if constexpr (anyHit)
+				{
+					active = AndNot(active, hits);
+					if (!active.Any())
+						return found;
+				}
+			}
+
+			auto const leaf = [this, &visit, pShared](uint32_t index, Lanes& tMax, Mask active)
+			{
+				return visit(m_Bounded[index], tMax, active, pShared ? &pShared->bounded[index] : nullptr);
+			};
+
+			if (m_Acceleration == Acceleration::grid)
+				return found | JL::Traverse<anyHit>(m_Grid, packet, tMax, active, leaf);
+			return found | JL::Traverse<anyHit>(m_Hierarchy, packet, tMax, active, leaf);
+		}
+
+		template<bool anyHit = false, int W, typename Callable>
+		simd::Mask<W> Traverse(RayPacket<N, W> const& packet, simd::Lanes<W>& tMax, simd::Mask<W> active, Callable const& callable) const
+		{
+			return Traverse<anyHit>(packet, tMax, active, nullptr, callable);
+		}
+
+	private:
+
+		template<typename Object>
+		using Stored = std::conditional_t<IsReferenced<Geometry<Object>>::value, Geometry<Object> const*, Geometry<Object>>;
+
+		std::tuple<std::vector<Stored<Objects>>...> m_Tables;
+		std::vector<Material> m_Materials;
+		std::vector<Primitive> m_Bounded;   // in the order of the hierarchy's primitives
+		std::vector<Primitive> m_Unbounded;
+		Acceleration m_Acceleration{ Acceleration::bvh };
+		Hierarchy m_Hierarchy;
+		Grid m_Grid;
+
+		template<typename Geometry>
+		static Geometry const& Dereference(Geometry const& geometry) noexcept
+		{
+			return geometry;
+		}
+
+		template<typename Geometry>
+		static Geometry const& Dereference(Geometry const* pGeometry) noexcept
+		{
+			return *pGeometry;
+		}
+
+		// Tests the type against every table in turn, there are only a few
+		template<typename Callable, size_t First, size_t... Rest>
+		auto VisitTables(Primitive const& primitive, Callable const& callable, std::index_sequence<First, Rest...>) const
+		{
+			if constexpr (sizeof...(Rest) != 0)
+				if (primitive.GetType() != First)
+					return VisitTables(primitive, callable, std::index_sequence<Rest...>{});
+			return callable(Dereference(std::get<First>(m_Tables)[primitive.GetIndex()]));
+		}
+
+	};
+
+}
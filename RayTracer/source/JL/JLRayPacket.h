@@ -0,0 +1,772 @@
+// RayPacket.h - Coherent ray packets traced W lanes at a time.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include "JLBaseIncludes.h"
+#include "JLSimd.h"
+#include "JLBVH.h"
+#include "JLWideBVH.h"
+#include "JLLazyBVH.h"
+#include "JLCalculus.h"
+#include <type_traits>
+
+namespace JL
+{
+
+	// A packet holds W rays in structure of arrays layout, one ray per lane.
+	// Lanes that are not active never report hits, whatever their values.
+	// Packets are single precision only: the lanes are floats.
+
+	template<int N, int W>
+	struct RayPacket
+	{
+		using Lanes = simd::Lanes<W>;
+		using Mask = simd::Mask<W>;
+		using Point = Point<N, float>;
+		using Vector = Vector<N, float>;
+
+		Lanes origin[N];
+		Lanes direction[N];
+		Lanes inverse[N];
+		Lanes tMin;
+		Lanes tMax;
+		Mask active;
+
+		RayPacket(Point const (&origins)[W], Vector const (&directions)[W], float tMin, float tMax, Mask active)
+			: tMin{ Lanes::Broadcast(tMin) }
+			, tMax{ Lanes::Broadcast(tMax) }
+			, active{ active }
+		{
+			for (int axis{}; axis < N; ++axis)
+			{
+				float values[W];
+				for (int lane{}; lane < W; ++lane)
+					values[lane] = origins[lane].data[axis];
+				origin[axis] = Lanes::Load(values);
+			}
+			SetDirections(directions);
+		}
+
+		// Shared origin, as for camera rays and point light shadow rays
+		RayPacket(Point const& sharedOrigin, Vector const (&directions)[W], float tMin, float tMax, Mask active)
+			: tMin{ Lanes::Broadcast(tMin) }
+			, tMax{ Lanes::Broadcast(tMax) }
+			, active{ active }
+		{
+			for (int axis{}; axis < N; ++axis)
+				origin[axis] = Lanes::Broadcast(sharedOrigin.data[axis]);
+			SetDirections(directions);
+		}
+
+		// Shared direction, as for directional light shadow rays
+		RayPacket(Point const (&origins)[W], Vector const& sharedDirection, float tMin, float tMax, Mask active)
+			: tMin{ Lanes::Broadcast(tMin) }
+			, tMax{ Lanes::Broadcast(tMax) }
+			, active{ active }
+		{
+			for (int axis{}; axis < N; ++axis)
+			{
+				float values[W];
+				for (int lane{}; lane < W; ++lane)
+					values[lane] = origins[lane].data[axis];
+				origin[axis] = Lanes::Load(values);
+				direction[axis] = Lanes::Broadcast(sharedDirection.data[axis]);
+				inverse[axis] = Lanes::Broadcast(1.f / sharedDirection.data[axis]);
+			}
+		}
+
+	private:
+
+		void SetDirections(Vector const (&directions)[W])
+		{
+			for (int axis{}; axis < N; ++axis)
+			{
+				float values[W];
+				for (int lane{}; lane < W; ++lane)
+					values[lane] = directions[lane].data[axis];
+				direction[axis] = Lanes::Load(values);
+				inverse[axis] = Lanes::Broadcast(1.f) / direction[axis];
+			}
+		}
+
+	};
+
+	// Per lane counterpart of Intersection
+	template<int W>
+	struct PacketIntersection
+	{
+		simd::Lanes<W> t;
+		void const* hitFace[W]{};
+		simd::Lanes<W> u{}; // barycentric coordinates, for lanes whose hitFace has them
+		simd::Lanes<W> v{};
+	};
+
+	namespace packet
+	{
+
+		template<int N, int W>
+		simd::Lanes<W> Dot(simd::Lanes<W> const (&a)[N], Vector<N, float> const& b) noexcept
+		{
+			simd::Lanes<W> result{ a[0] * simd::Lanes<W>::Broadcast(b.data[0]) };
+			for (int axis{ 1 }; axis < N; ++axis)
+				result = result + a[axis] * simd::Lanes<W>::Broadcast(b.data[axis]);
+			return result;
+		}
+
+		template<int N, int W>
+		simd::Lanes<W> Dot(simd::Lanes<W> const (&a)[N], simd::Lanes<W> const (&b)[N]) noexcept
+		{
+			simd::Lanes<W> result{ a[0] * b[0] };
+			for (int axis{ 1 }; axis < N; ++axis)
+				result = result + a[axis] * b[axis];
+			return result;
+		}
+
+		// Lanes of origin - point
+		template<int N, int W>
+		void Distance(simd::Lanes<W> (&result)[N], simd::Lanes<W> const (&origin)[N], Point<N, float> const& point) noexcept
+		{
+			for (int axis{}; axis < N; ++axis)
+				result[axis] = origin[axis] - simd::Lanes<W>::Broadcast(point.data[axis]);
+		}
+
+		// The packet in the object space of an instance. Directions are not normalized, so lane distances carry over
+		template<int N, int W>
+		RayPacket<N, W> ToObject(RayPacket<N, W> const& packet, MeshInstance<N, float> const& instance)
+		{
+			using Lanes = simd::Lanes<W>;
+			auto const& inverse{ instance.GetInverse() };
+			auto const& translation{ instance.GetTranslation() };
+
+			Lanes origin[N];
+			Distance<N, W>(origin, packet.origin, Point<N, float>{ translation });
+
+			RayPacket<N, W> result{ packet };
+			for (int row{}; row < N; ++row)
+			{
+				result.origin[row] = origin[0] * Lanes::Broadcast(inverse(row, 0));
+				result.direction[row] = packet.direction[0] * Lanes::Broadcast(inverse(row, 0));
+				for (int column{ 1 }; column < N; ++column)
+				{
+					result.origin[row] = result.origin[row] + origin[column] * Lanes::Broadcast(inverse(row, column));
+					result.direction[row] = result.direction[row] + packet.direction[column] * Lanes::Broadcast(inverse(row, column));
+				}
+				result.inverse[row] = Lanes::Broadcast(1.f) / result.direction[row];
+			}
+			return result;
+		}
+
+	}
+
+	// Slab test of every lane against a single box.
+	template<int N, int W>
+	simd::Mask<W> Intersect(simd::Lanes<W>& entry, RayPacket<N, W> const& packet, Box<N, float> const& box, simd::Lanes<W> const& tMax, simd::Mask<W> active)
+	{
+		using Lanes = simd::Lanes<W>;
+		Lanes near{ packet.tMin };
+		Lanes far{ tMax };
+		for (int axis{}; axis < N; ++axis)
+		{
+			const Lanes t0{ (Lanes::Broadcast(box.min.data[axis]) - packet.origin[axis]) * packet.inverse[axis] };
+			const Lanes t1{ (Lanes::Broadcast(box.max.data[axis]) - packet.origin[axis]) * packet.inverse[axis] };
+			near = Max(near, Min(t0, t1));
+			far = Min(far, Max(t0, t1));
+		}
+		entry = near;
+		return active & (near <= far);
+	}
+
+	// Packet traversal: a node is entered when any active lane hits its bounds.
+	// Children are visited in the order of the closest entry over all lanes.
+	// hit(Index primitive, Lanes& tMax, Mask active) -> Mask must only report lanes hit within [tMin, tMax) and shrink tMax for them.
+	// With anyHit, a lane retires at its first hit and traversal stops once no lane is left.
+	template<bool anyHit = false, int N, int W, typename Hit>
+	simd::Mask<W> Traverse(BVH<N, float> const& hierarchy, RayPacket<N, W> const& packet, simd::Lanes<W>& tMax, simd::Mask<W> active, Hit&& hit)
+	{
+		using Lanes = simd::Lanes<W>;
+		using Mask = simd::Mask<W>;
+		using Index = typename BVH<N, float>::Index;
+
+		Mask found{ Mask::None() };
+
+		auto const& nodes{ hierarchy.GetNodes() };
+		auto const& indices{ hierarchy.GetIndices() };
+		if (nodes.empty())
+			return found;
+
+		Lanes entry{};
+		if (!Intersect(entry, packet, nodes.front().bounds, tMax, active).Any())
+			return found;
+
+		Index stack[BVH<N, float>::STACK_SIZE];
+		size_t size{};
+		Index current{ 0 };
+
+		while (true)
+		{
+			auto const& node{ nodes[current] };
+			TraversalCounter::CountVisit(&node);
+			if (node.IsLeaf())
+			{
+				for (Index i{ node.offset }; i < node.offset + node.count; ++i)
+				{
+					const Mask hits{ hit(indices[i], tMax, active) };
+					found = found | hits;
+					if constexpr (anyHit)
+					{
+						active = AndNot(active, hits);
+						if (!active.Any())
+							return found;
+					}
+				}
+			}
+			else
+			{
+				Index near{ current + 1 };
+				Index far{ node.offset };
+				Lanes nearT{}, farT{};
+				const Mask nearHit{ Intersect(nearT, packet, nodes[near].bounds, tMax, active) };
+				const Mask farHit{ Intersect(farT, packet, nodes[far].bounds, tMax, active) };
+
+				if (nearHit.Any() && farHit.Any())
+				{
+					const Lanes none{ Lanes::Broadcast(std::numeric_limits<float>::max()) };
+					if (simd::ReduceMin(Select(farHit, farT, none)) < simd::ReduceMin(Select(nearHit, nearT, none)))
+						std::swap(near, far);
+					stack[size++] = far;
+					current = near;
+					continue;
+				}
+				else if (nearHit.Any())
+				{
+					current = near;
+					continue;
+				}
+				else if (farHit.Any())
+				{
+					current = far;
+					continue;
+				}
+			}
+
+			// pop the next node some lane can still reach with its current tMax
+			while (size != 0 && !Intersect(entry, packet, nodes[stack[size - 1]].bounds, tMax, active).Any())
+				--size;
+			if (size == 0)
+				break;
+			current = stack[--size];
+		}
+
+		return found;
+	}
+
+	// Packet traversal of a lazy hierarchy, splitting the nodes it reaches. Same contract and order as for a BVH
+	template<bool anyHit = false, int N, int W, typename Hit>
+	simd::Mask<W> Traverse(LazyBVH<N, float> const& hierarchy, RayPacket<N, W> const& packet, simd::Lanes<W>& tMax, simd::Mask<W> active, Hit&& hit)
+	{
+		using Lanes = simd::Lanes<W>;
+		using Mask = simd::Mask<W>;
+		using Index = typename LazyBVH<N, float>::Index;
+
+		Mask found{ Mask::None() };
+
+		if (hierarchy.IsEmpty())
+			return found;
+		auto const* const nodes{ hierarchy.GetNodes() };
+		auto const& indices{ hierarchy.GetIndices() };
+
+		Lanes entry{};
+		if (!Intersect(entry, packet, nodes[0].bounds, tMax, active).Any())
+			return found;
+
+		Index stack[LazyBVH<N, float>::STACK_SIZE];
+		size_t size{};
+		Index current{ 0 };
+
+		while (true)
+		{
+			auto const& node{ hierarchy.Expand(current) };
+			TraversalCounter::CountVisit(&node);
+			if (node.IsLeaf())
+			{
+				for (Index i{ node.offset }; i < node.offset + node.count; ++i)
+				{
+					const Mask hits{ hit(indices[i], tMax, active) };
+					found = found | hits;
+					if constexpr (anyHit)
+					{
+						active = AndNot(active, hits);
+						if (!active.Any())
+							return found;
+					}
+				}
+			}
+			else
+			{
+				Index near{ current + 1 };
+				Index far{ node.offset };
+				Lanes nearT{}, farT{};
+				const Mask nearHit{ Intersect(nearT, packet, nodes[near].bounds, tMax, active) };
+				const Mask farHit{ Intersect(farT, packet, nodes[far].bounds, tMax, active) };
+
+				if (nearHit.Any() && farHit.Any())
+				{
+					const Lanes none{ Lanes::Broadcast(std::numeric_limits<float>::max()) };
+					if (simd::ReduceMin(Select(farHit, farT, none)) < simd::ReduceMin(Select(nearHit, nearT, none)))
+						std::swap(near, far);
+					stack[size++] = far;
+					current = near;
+					continue;
+				}
+				else if (nearHit.Any())
+				{
+					current = near;
+					continue;
+				}
+				else if (farHit.Any())
+				{
+					current = far;
+					continue;
+				}
+			}
+
+			// pop the next node some lane can still reach with its current tMax
+			while (size != 0 && !Intersect(entry, packet, nodes[stack[size - 1]].bounds, tMax, active).Any())
+				--size;
+			if (size == 0)
+				break;
+			current = stack[--size];
+		}
+
+		return found;
+	}
+
+	// Packet traversal of a wide hierarchy: every child is tested against the whole packet in turn,
+	// and the ones any active lane hits are visited in the order of their closest entry over all lanes.
+	// Same contract as for a BVH
+	template<bool anyHit = false, int N, int C, int W, typename Hit>
+	simd::Mask<W> Traverse(WideBVH<N, float, C> const& hierarchy, RayPacket<N, W> const& packet, simd::Lanes<W>& tMax, simd::Mask<W> active, Hit&& hit)
+	{
+		using Lanes = simd::Lanes<W>;
+		using Mask = simd::Mask<W>;
+		using Hierarchy = WideBVH<N, float, C>;
+		using Index = typename Hierarchy::Index;
+
+		Mask found{ Mask::None() };
+
+		auto const& nodes{ hierarchy.GetNodes() };
+		auto const& indices{ hierarchy.GetIndices() };
+		if (nodes.empty())
+			return found;
+
+		Lanes entry{};
+		if (!Intersect(entry, packet, hierarchy.GetBounds(), tMax, active).Any())
+			return found;
+
+		// Children pushed are skipped once their closest entry is beyond every active lane's tMax
+		struct Entry
+		{
+			Index child; // node or first primitive
+			uint32_t count;
+			float t;
+		} stack[Hierarchy::STACK_SIZE];
+		size_t size{};
+		stack[size++] = { 0, Hierarchy::INTERIOR, simd::ReduceMin(entry) };
+
+		const Lanes none{ Lanes::Broadcast(std::numeric_limits<float>::max()) };
+		float farthest{ simd::ReduceMax(Select(active, tMax, -none)) };
+		while (size != 0)
+		{
+			const Entry current{ stack[--size] };
+			if (current.t > farthest)
+				continue;
+
+			if (current.count != Hierarchy::INTERIOR)
+			{
+				for (Index i{ current.child }; i < current.child + current.count; ++i)
+				{
+					const Mask lanes{ hit(indices[i], tMax, active) };
+					if (!lanes.Any())
+						continue;
+					found = found | lanes;
+					if constexpr (anyHit)
+					{
+						active = AndNot(active, lanes);
+						if (!active.Any())
+							return found;
+					}
+					farthest = simd::ReduceMax(Select(active, tMax, -none));
+				}
+				continue;
+			}
+
+			auto const& node{ nodes[current.child] };
+			TraversalCounter::CountVisit(&node);
+
+			float min[N][C], max[N][C];
+			node.GetBounds(min, max);
+
+			// onto the stack nearest last, so it is popped first
+			const size_t first{ size };
+			for (int child{}; child < C; ++child)
+			{
+				if (node.IsEmpty(child))
+					continue;
+				Lanes near{ packet.tMin };
+				Lanes far{ tMax };
+				for (int axis{}; axis < N; ++axis)
+				{
+					const Lanes t0{ (Lanes::Broadcast(min[axis][child]) - packet.origin[axis]) * packet.inverse[axis] };
+					const Lanes t1{ (Lanes::Broadcast(max[axis][child]) - packet.origin[axis]) * packet.inverse[axis] };
+					near = Max(near, Min(t0, t1));
+					far = Min(far, Max(t0, t1));
+				}
+				const Mask lanes{ active & (near <= far) };
+				if (!lanes.Any())
+					continue;
+
+				Entry const pushed{ node.children[child], node.counts[child], simd::ReduceMin(Select(lanes, near, none)) };
+				size_t at{ size++ };
+				for (; at > first && stack[at - 1].t < pushed.t; --at)
+					stack[at] = stack[at - 1];
+				stack[at] = pushed;
+			}
+		}
+
+		return found;
+	}
+
+	// Lane distances to single primitives. The returned mask holds the lanes that pass culling,
+	// range checks against tMin and tMax are left to the caller.
+
+	// The terms of the plane and sphere tests that only depend on the ray origin.
+	// Packets whose lanes all start at one point (camera rays, point light shadow rays) can take them precomputed,
+	// once per origin and object instead of once per packet. Computed as the lanes do, so the results are the same either way
+
+	// Also for objects derived from planes and spheres
+	template<int N, typename Object>
+	constexpr bool HAS_ORIGIN_TERM = std::is_base_of_v<Plane<N, float>, Object> || std::is_base_of_v<Circular<N, float>, Object>;
+
+	// Distance from the origin to the plane, along its normal
+	template<int N>
+	float OriginTerm(Point<N, float> const& origin, Plane<N, float> const& plane) noexcept
+	{
+		float dot{ (origin.data[0] - plane.origin.data[0]) * plane.normal.data[0] };
+		for (int axis{ 1 }; axis < N; ++axis)
+			dot = dot + (origin.data[axis] - plane.origin.data[axis]) * plane.normal.data[axis];
+		return -dot;
+	}
+
+	// Square distance from the origin to the centre, minus the square radius
+	template<int N>
+	float OriginTerm(Point<N, float> const& origin, Circular<N, float> const& round) noexcept
+	{
+		float dot{ (origin.data[0] - round.center.data[0]) * (origin.data[0] - round.center.data[0]) };
+		for (int axis{ 1 }; axis < N; ++axis)
+			dot = dot + (origin.data[axis] - round.center.data[axis]) * (origin.data[axis] - round.center.data[axis]);
+		return dot - round.radius * round.radius;
+	}
+
+	namespace packet
+	{
+
+		template<CullMode::Flag cullmode, int N, int W>
+		simd::Mask<W> IntersectPlane(simd::Lanes<W>& t, RayPacket<N, W> const& packet, Plane<N, float> const& plane, simd::Lanes<W> const& originTerm)
+		{
+			using Lanes = simd::Lanes<W>;
+
+			const Lanes divisor{ Dot<N, W>(packet.direction, plane.normal) };
+			const Lanes zero{ Lanes::Broadcast(0.f) };
+			t = originTerm / divisor;
+
+			if constexpr (bool(cullmode & CullFlag::both))
+				return (divisor < zero) | (divisor > zero);
+			else if constexpr (bool(cullmode & CullFlag::front))
+				return divisor < zero;
+			else
+				return divisor > zero;
+		}
+
+		// c: the origin term, the rest of the quadratic depends on the directions
+		template<CullMode::Flag cullmode, int N, int W>
+		simd::Mask<W> IntersectCircular(simd::Lanes<W>& t, RayPacket<N, W> const& packet, Circular<N, float> const& round, simd::Lanes<W> const& c)
+		{
+			using Lanes = simd::Lanes<W>;
+
+			Lanes distance[N];
+			Distance<N, W>(distance, packet.origin, round.center);
+
+			const Lanes a{ Dot<N, W>(packet.direction, packet.direction) };
+			const Lanes b{ Dot<N, W>(packet.direction, distance) * Lanes::Broadcast(2.f) };
+			const Lanes d{ b * b - a * c * Lanes::Broadcast(4.f) };
+
+			const Lanes zero{ Lanes::Broadcast(0.f) };
+			const Lanes root{ Sqrt(Max(d, zero)) };
+			const Lanes divisor{ a * Lanes::Broadcast(2.f) };
+
+			if constexpr (bool(cullmode & CullFlag::both))
+			{
+				// nearest root in front of tMin: shadow packets start on the surfaces they are cast from
+				const Lanes first{ (-b - root) / divisor };
+				const Lanes second{ (-b + root) / divisor };
+				const Lanes near{ Min(first, second) };
+				t = Select(near >= packet.tMin, near, Max(first, second));
+			}
+			else if constexpr (bool(cullmode & CullFlag::front))
+				t = (-b - root) / divisor;
+			else
+				t = (-b + root) / divisor;
+
+			return d >= zero;
+		}
+
+	}
+
+	template<CullMode::Flag cullmode, int N, int W>
+	simd::Mask<W> Intersect(simd::Lanes<W>& t, RayPacket<N, W> const& packet, Plane<N, float> const& plane)
+	{
+		simd::Lanes<W> distance[N];
+		packet::Distance<N, W>(distance, packet.origin, plane.origin);
+		return packet::IntersectPlane<cullmode, N, W>(t, packet, plane, -packet::Dot<N, W>(distance, plane.normal));
+	}
+
+	// Every lane starts where OriginTerm(origin, plane) was computed for
+	template<CullMode::Flag cullmode, int N, int W>
+	simd::Mask<W> Intersect(simd::Lanes<W>& t, RayPacket<N, W> const& packet, Plane<N, float> const& plane, float originTerm)
+	{
+		return packet::IntersectPlane<cullmode, N, W>(t, packet, plane, simd::Lanes<W>::Broadcast(originTerm));
+	}
+
+	template<CullMode::Flag cullmode, int N, int W>
+	simd::Mask<W> Intersect(simd::Lanes<W>& t, RayPacket<N, W> const& packet, Circular<N, float> const& round)
+	{
+		using Lanes = simd::Lanes<W>;
+		Lanes distance[N];
+		packet::Distance<N, W>(distance, packet.origin, round.center);
+		return packet::IntersectCircular<cullmode, N, W>(t, packet, round, packet::Dot<N, W>(distance, distance) - Lanes::Broadcast(round.radius * round.radius));
+	}
+
+	// Every lane starts where OriginTerm(origin, round) was computed for
+	template<CullMode::Flag cullmode, int N, int W>
+	simd::Mask<W> Intersect(simd::Lanes<W>& t, RayPacket<N, W> const& packet, Circular<N, float> const& round, float originTerm)
+	{
+		return packet::IntersectCircular<cullmode, N, W>(t, packet, round, simd::Lanes<W>::Broadcast(originTerm));
+	}
+
+	// Moller-Trumbore on a baked triangle, also reports the barycentric coordinates per lane
+	template<CullMode::Flag cullmode, int N, int W>
+	simd::Mask<W> Intersect(simd::Lanes<W>& t, simd::Lanes<W>& u, simd::Lanes<W>& v, RayPacket<N, W> const& packet, TriangleRecord<N, float> const& triangle)
+	{
+		static_assert(N == 3, "Triangles need a cross product");
+		using Lanes = simd::Lanes<W>;
+
+		const Lanes edge1[N]{ Lanes::Broadcast(triangle.edge1.x), Lanes::Broadcast(triangle.edge1.y), Lanes::Broadcast(triangle.edge1.z) };
+		const Lanes edge2[N]{ Lanes::Broadcast(triangle.edge2.x), Lanes::Broadcast(triangle.edge2.y), Lanes::Broadcast(triangle.edge2.z) };
+		Lanes const (&direction)[N]{ packet.direction };
+
+		const Lanes p[N]{
+			direction[1] * edge2[2] - direction[2] * edge2[1],
+			direction[2] * edge2[0] - direction[0] * edge2[2],
+			direction[0] * edge2[1] - direction[1] * edge2[0]
+		};
+		const Lanes det{ packet::Dot<N, W>(edge1, p) };
+
+		const Lanes zero{ Lanes::Broadcast(0.f) };
+		const Lanes one{ Lanes::Broadcast(1.f) };
+
+		simd::Mask<W> valid{};
+		if constexpr (bool(cullmode & CullFlag::both))
+			valid = (det < zero) | (det > zero);
+		else if constexpr (bool(cullmode & CullFlag::front))
+			valid = det > zero;
+		else
+			valid = det < zero;
+
+		const Lanes inverse{ one / det };
+
+		Lanes distance[N];
+		packet::Distance<N, W>(distance, packet.origin, triangle.origin);
+		u = packet::Dot<N, W>(distance, p) * inverse;
+
+		const Lanes q[N]{
+			distance[1] * edge1[2] - distance[2] * edge1[1],
+			distance[2] * edge1[0] - distance[0] * edge1[2],
+			distance[0] * edge1[1] - distance[1] * edge1[0]
+		};
+		v = packet::Dot<N, W>(direction, q) * inverse;
+		t = packet::Dot<N, W>(q, triangle.edge2) * inverse;
+
+		return valid & (u >= zero) & (u <= one) & (v >= zero) & (u + v <= one);
+	}
+
+	// Closest (or any) hit per lane within [tMin, tMax).
+	// result is only written for the lanes in the returned mask.
+	// pOriginTerm: the object's OriginTerm for the origin every lane starts at, if any. Objects without one ignore it
+	template<CullMode::Flag cullmode, bool anyHit = false, int N, int W, template<int, typename> typename Object>
+	simd::Mask<W> Intersect(PacketIntersection<W>& result, RayPacket<N, W> const& packet, Object<N, float> const& object, simd::Lanes<W> const& tMax, simd::Mask<W> active, float const* pOriginTerm = nullptr)
+	{
+		using Lanes = simd::Lanes<W>;
+		using Mask = simd::Mask<W>;
+
+		if constexpr (cullmode == CullMode::none)
+		{
+			return Mask::None();
+		}
+		else if constexpr (std::is_same_v<Object<N, float>, Mesh<N, float>>)
+		{
+			auto const& records{ object.GetRecords() };
+			auto const hitTriangle = [&result, &packet, &records](auto const index, Lanes& tMax, Mask active) -> Mask
+			{
+				Lanes t{}, u{}, v{};
+				const Mask valid{ Intersect<cullmode, N, W>(t, u, v, packet, records[index]) };
+				const Mask hits{ valid & active & (t >= packet.tMin) & (t < tMax) };
+				if (hits.Any())
+				{
+					tMax = Select(hits, t, tMax);
+					result.t = Select(hits, t, result.t);
+					result.u = Select(hits, u, result.u);
+					result.v = Select(hits, v, result.v);
+					simd::ForEachLane(hits, [&result, &records, index](int lane) { result.hitFace[lane] = &records[index]; });
+				}
+				return hits;
+			};
+			Lanes limit{ tMax };
+			if (object.IsLazy())
+				return Traverse<anyHit>(object.GetLazyHierarchy(), packet, limit, active, hitTriangle);
+			return Traverse<anyHit>(object.GetHierarchy(), packet, limit, active, hitTriangle);
+		}
+		else if constexpr (std::is_same_v<Object<N, float>, MeshInstance<N, float>>)
+		{
+			return Intersect<cullmode, anyHit, N, W, Mesh>(result, packet::ToObject(packet, object), object.GetMesh(), tMax, active);
+		}
+		else if constexpr (std::is_same_v<Object<N, float>, SphereSet<N, float>>)
+		{
+			// The packet traverses the clusters, then every lane that reaches one tests all of its spheres at once
+			float origins[N][W], directions[N][W], tMins[W];
+			for (int axis{}; axis < N; ++axis)
+			{
+				packet.origin[axis].Store(origins[axis]);
+				packet.direction[axis].Store(directions[axis]);
+			}
+			packet.tMin.Store(tMins);
+
+			Lanes limit{ tMax };
+			return Traverse<anyHit>(
+				object.GetHierarchy(), packet, limit, active,
+				[&result, &packet, &object, &origins, &directions, &tMins](auto const index, Lanes& tMax, Mask active) -> Mask
+				{
+					// leaves hold a few clusters, most lanes miss most of them
+					Lanes entry{};
+					active = Intersect(entry, packet, object.GetBounds()[index], tMax, active);
+					if (!active.Any())
+						return active;
+
+					float limits[W];
+					tMax.Store(limits);
+					uint32_t bits{};
+					simd::ForEachLane(
+						active,
+						[&](int lane)
+						{
+							Line<N, float> line{};
+							for (int axis{}; axis < N; ++axis)
+							{
+								line.origin.data[axis] = origins[axis][lane];
+								line.direction.data[axis] = directions[axis][lane];
+							}
+							Intersection<N, float> hit{};
+							if (Intersect<cullmode, N>(hit, line, object, index, tMins[lane], limits[lane]))
+							{
+								limits[lane] = hit.t;
+								result.hitFace[lane] = hit.hitFace;
+								bits |= 1u << lane;
+							}
+						}
+					);
+
+					const Mask hits{ Mask::FromBits(bits) };
+					if (hits.Any())
+					{
+						tMax = Lanes::Load(limits);
+						result.t = Select(hits, tMax, result.t);
+					}
+					return hits;
+				}
+			);
+		}
+		else
+		{
+			Lanes t{};
+			Mask valid{};
+			if constexpr (HAS_ORIGIN_TERM<N, Object<N, float>>)
+				valid = pOriginTerm ? Intersect<cullmode, N, W>(t, packet, object, *pOriginTerm) : Intersect<cullmode, N, W>(t, packet, object);
+			else
+				valid = Intersect<cullmode, N, W>(t, packet, object);
+			const Mask hits{ valid & active & (t >= packet.tMin) & (t < tMax) };
+			result.t = Select(hits, t, result.t);
+			return hits;
+		}
+	}
+
+	template<int N, int W, template<int, typename> typename Object>
+	simd::Mask<W> Intersect(PacketIntersection<W>& result, RayPacket<N, W> const& packet, Object<N, float> const& object, CullMode::Flag cullmode, simd::Lanes<W> const& tMax, simd::Mask<W> active, float const* pOriginTerm = nullptr)
+	{
+		switch (cullmode)
+		{
+		case CullMode::front:
+			return Intersect<CullMode::front, false, N, W, Object>(result, packet, object, tMax, active, pOriginTerm);
+		case CullMode::both:
+			return Intersect<CullMode::both, false, N, W, Object>(result, packet, object, tMax, active, pOriginTerm);
+		case CullMode::back:
+			return Intersect<CullMode::back, false, N, W, Object>(result, packet, object, tMax, active, pOriginTerm);
+		default:
+			return simd::Mask<W>::None();
+		}
+	}
+
+	// Shadow query per lane: is there any hit within [tMin, tMax)
+	template<CullMode::Flag cullmode, int N, int W, template<int, typename> typename Object>
+	simd::Mask<W> Occluded(RayPacket<N, W> const& packet, Object<N, float> const& object, simd::Lanes<W> const& tMax, simd::Mask<W> active, float const* pOriginTerm = nullptr)
+	{
+		PacketIntersection<W> result{};
+		return Intersect<cullmode, true, N, W, Object>(result, packet, object, tMax, active, pOriginTerm);
+	}
+
+	// Same, with the cull mode known at run time
+	template<int N, int W, template<int, typename> typename Object>
+	simd::Mask<W> Occluded(RayPacket<N, W> const& packet, Object<N, float> const& object, CullMode::Flag cullmode, simd::Lanes<W> const& tMax, simd::Mask<W> active, float const* pOriginTerm = nullptr)
+	{
+		PacketIntersection<W> result{};
+		switch (cullmode)
+		{
+		case CullMode::front:
+			return Intersect<CullMode::front, true, N, W, Object>(result, packet, object, tMax, active, pOriginTerm);
+		case CullMode::both:
+			return Intersect<CullMode::both, true, N, W, Object>(result, packet, object, tMax, active, pOriginTerm);
+		case CullMode::back:
+			return Intersect<CullMode::back, true, N, W, Object>(result, packet, object, tMax, active, pOriginTerm);
+		default:
+			return simd::Mask<W>::None();
+		}
+	}
+
+}
@@ -0,0 +1,467 @@
+// Simd.h - Float lanes and lane masks for 4, 8 and 16 wide SIMD.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define JL_SIMD_X86
+	#include <immintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#endif
+#endif
+
+// MSVC accepts every intrinsic regardless of /arch, other compilers only those enabled for the translation unit.
+// Widths without intrinsics fall back to plain loops, which are still correct.
+#if defined(JL_SIMD_X86)
+	#define JL_SIMD_SSE 1
+	#if defined(_MSC_VER) || defined(__SSSE3__)
+		#define JL_SIMD_SSSE3 1
+	#endif
+	#if defined(_MSC_VER) || defined(__AVX2__)
+		#define JL_SIMD_AVX2 1
+	#endif
+	#if defined(_MSC_VER) || defined(__AVX512F__)
+		#define JL_SIMD_AVX512 1
+	#endif
+#endif
+
+namespace JL
+{
+	namespace simd
+	{
+
+		//
+		// Generic lanes: one float per lane, a bit per lane for masks
+		//
+
+		template<int W>
+		struct Mask
+		{
+			static_assert(W <= 32, "Mask holds up to 32 lanes");
+
+			uint32_t bits;
+
+			static Mask All() noexcept { return { W == 32 ? ~0u : ((1u << W) - 1u) }; }
+			static Mask None() noexcept { return { 0u }; }
+			static Mask FromBits(uint32_t bits) noexcept { return Mask{ bits } & All(); }
+
+			uint32_t Bits() const noexcept { return bits; }
+			bool Any() const noexcept { return bits != 0; }
+
+			friend Mask operator & (Mask a, Mask b) noexcept { return { a.bits & b.bits }; }
+			friend Mask operator | (Mask a, Mask b) noexcept { return { a.bits | b.bits }; }
+			friend Mask AndNot(Mask a, Mask b) noexcept { return { a.bits & ~b.bits }; } // a and not b
+		};
+
+		template<int W>
+		struct Lanes
+		{
+			float data[W];
+
+			static Lanes Broadcast(float value) noexcept { Lanes out; for (int i{}; i < W; ++i) out.data[i] = value; return out; }
+			static Lanes Load(float const* values) noexcept { Lanes out; for (int i{}; i < W; ++i) out.data[i] = values[i]; return out; }
+			static Lanes LoadBytes(uint8_t const* values) noexcept { Lanes out; for (int i{}; i < W; ++i) out.data[i] = float(values[i]); return out; } // W unsigned bytes
+			void Store(float* values) const noexcept { for (int i{}; i < W; ++i) values[i] = data[i]; }
+
+#define JL_SIMD_GENERIC_OPERATOR(op) \
+			friend Lanes operator op (Lanes const& a, Lanes const& b) noexcept { Lanes out; for (int i{}; i < W; ++i) out.data[i] = a.data[i] op b.data[i]; return out; }
+			JL_SIMD_GENERIC_OPERATOR(+)
+			JL_SIMD_GENERIC_OPERATOR(-)
+			JL_SIMD_GENERIC_OPERATOR(*)
+			JL_SIMD_GENERIC_OPERATOR(/)
+#undef JL_SIMD_GENERIC_OPERATOR
+
+#define JL_SIMD_GENERIC_COMPARE(op) \
+			friend Mask<W> operator op (Lanes const& a, Lanes const& b) noexcept { uint32_t bits{}; for (int i{}; i < W; ++i) bits |= uint32_t(a.data[i] op b.data[i]) << i; return { bits }; }
+			JL_SIMD_GENERIC_COMPARE(<)
+			JL_SIMD_GENERIC_COMPARE(<=)
+			JL_SIMD_GENERIC_COMPARE(>)
+			JL_SIMD_GENERIC_COMPARE(>=)
+#undef JL_SIMD_GENERIC_COMPARE
+
+			friend Lanes operator - (Lanes const& a) noexcept { Lanes out; for (int i{}; i < W; ++i) out.data[i] = -a.data[i]; return out; }
+			friend Lanes Min(Lanes const& a, Lanes const& b) noexcept { Lanes out; for (int i{}; i < W; ++i) out.data[i] = std::min(a.data[i], b.data[i]); return out; }
+			friend Lanes Max(Lanes const& a, Lanes const& b) noexcept { Lanes out; for (int i{}; i < W; ++i) out.data[i] = std::max(a.data[i], b.data[i]); return out; }
+			friend Lanes Sqrt(Lanes const& a) noexcept { Lanes out; for (int i{}; i < W; ++i) out.data[i] = std::sqrt(a.data[i]); return out; }
+			// mask ? a : b
+			friend Lanes Select(Mask<W> mask, Lanes const& a, Lanes const& b) noexcept { Lanes out; for (int i{}; i < W; ++i) out.data[i] = (mask.bits >> i) & 1u ? a.data[i] : b.data[i]; return out; }
+		};
+
+#if defined(JL_SIMD_SSE)
+
+		//
+		// SSE: 4 lanes
+		//
+
+		template<>
+		struct Mask<4>
+		{
+			__m128 m;
+
+			static Mask All() noexcept { return { _mm_castsi128_ps(_mm_set1_epi32(-1)) }; }
+			static Mask None() noexcept { return { _mm_setzero_ps() }; }
+			static Mask FromBits(uint32_t bits) noexcept
+			{
+				const __m128i select{ _mm_setr_epi32(1, 2, 4, 8) };
+				return { _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(int(bits)), select), select)) };
+			}
+
+			uint32_t Bits() const noexcept { return uint32_t(_mm_movemask_ps(m)); }
+			bool Any() const noexcept { return _mm_movemask_ps(m) != 0; }
+
+			friend Mask operator & (Mask a, Mask b) noexcept { return { _mm_and_ps(a.m, b.m) }; }
+			friend Mask operator | (Mask a, Mask b) noexcept { return { _mm_or_ps(a.m, b.m) }; }
+			friend Mask AndNot(Mask a, Mask b) noexcept { return { _mm_andnot_ps(b.m, a.m) }; }
+		};
+
+		template<>
+		struct Lanes<4>
+		{
+			__m128 m;
+
+			static Lanes Broadcast(float value) noexcept { return { _mm_set1_ps(value) }; }
+			static Lanes Load(float const* values) noexcept { return { _mm_loadu_ps(values) }; }
+			static Lanes LoadBytes(uint8_t const* values) noexcept
+			{
+				int32_t bytes;
+				std::memcpy(&bytes, values, sizeof(bytes));
+				const __m128i zero{ _mm_setzero_si128() };
+				return { _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero)) };
+			}
+			void Store(float* values) const noexcept { _mm_storeu_ps(values, m); }
+
+			friend Lanes operator + (Lanes const& a, Lanes const& b) noexcept { return { _mm_add_ps(a.m, b.m) }; }
+			friend Lanes operator - (Lanes const& a, Lanes const& b) noexcept { return { _mm_sub_ps(a.m, b.m) }; }
+			friend Lanes operator * (Lanes const& a, Lanes const& b) noexcept { return { _mm_mul_ps(a.m, b.m) }; }
+			friend Lanes operator / (Lanes const& a, Lanes const& b) noexcept { return { _mm_div_ps(a.m, b.m) }; }
+			friend Mask<4> operator <  (Lanes const& a, Lanes const& b) noexcept { return { _mm_cmplt_ps(a.m, b.m) }; }
+			friend Mask<4> operator <= (Lanes const& a, Lanes const& b) noexcept { return { _mm_cmple_ps(a.m, b.m) }; }
+			friend Mask<4> operator >  (Lanes const& a, Lanes const& b) noexcept { return { _mm_cmpgt_ps(a.m, b.m) }; }
+			friend Mask<4> operator >= (Lanes const& a, Lanes const& b) noexcept { return { _mm_cmpge_ps(a.m, b.m) }; }
+			friend Lanes operator - (Lanes const& a) noexcept { return { _mm_xor_ps(a.m, _mm_set1_ps(-0.f)) }; }
+			friend Lanes Min(Lanes const& a, Lanes const& b) noexcept { return { _mm_min_ps(a.m, b.m) }; }
+			friend Lanes Max(Lanes const& a, Lanes const& b) noexcept { return { _mm_max_ps(a.m, b.m) }; }
+			friend Lanes Sqrt(Lanes const& a) noexcept { return { _mm_sqrt_ps(a.m) }; }
+			friend Lanes Select(Mask<4> mask, Lanes const& a, Lanes const& b) noexcept { return { _mm_or_ps(_mm_and_ps(mask.m, a.m), _mm_andnot_ps(mask.m, b.m)) }; }
+		};
+
+#endif
+#if defined(JL_SIMD_AVX2)
+
+		//
+		// AVX2: 8 lanes
+		//
+
+		template<>
+		struct Mask<8>
+		{
+			__m256 m;
+
+			static Mask All() noexcept { return { _mm256_castsi256_ps(_mm256_set1_epi32(-1)) }; }
+			static Mask None() noexcept { return { _mm256_setzero_ps() }; }
+			static Mask FromBits(uint32_t bits) noexcept
+			{
+				const __m256i select{ _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128) };
+				return { _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(int(bits)), select), select)) };
+			}
+
+			uint32_t Bits() const noexcept { return uint32_t(_mm256_movemask_ps(m)); }
+			bool Any() const noexcept { return _mm256_movemask_ps(m) != 0; }
+
+			friend Mask operator & (Mask a, Mask b) noexcept { return { _mm256_and_ps(a.m, b.m) }; }
+			friend Mask operator | (Mask a, Mask b) noexcept { return { _mm256_or_ps(a.m, b.m) }; }
+			friend Mask AndNot(Mask a, Mask b) noexcept { return { _mm256_andnot_ps(b.m, a.m) }; }
+		};
+
+		template<>
+		struct Lanes<8>
+		{
+			__m256 m;
+
+			static Lanes Broadcast(float value) noexcept { return { _mm256_set1_ps(value) }; }
+			static Lanes Load(float const* values) noexcept { return { _mm256_loadu_ps(values) }; }
+			static Lanes LoadBytes(uint8_t const* values) noexcept { return { _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(values)))) }; }
+			void Store(float* values) const noexcept { _mm256_storeu_ps(values, m); }
+
+			friend Lanes operator + (Lanes const& a, Lanes const& b) noexcept { return { _mm256_add_ps(a.m, b.m) }; }
+			friend Lanes operator - (Lanes const& a, Lanes const& b) noexcept { return { _mm256_sub_ps(a.m, b.m) }; }
+			friend Lanes operator * (Lanes const& a, Lanes const& b) noexcept { return { _mm256_mul_ps(a.m, b.m) }; }
+			friend Lanes operator / (Lanes const& a, Lanes const& b) noexcept { return { _mm256_div_ps(a.m, b.m) }; }
+			friend Mask<8> operator <  (Lanes const& a, Lanes const& b) noexcept { return { _mm256_cmp_ps(a.m, b.m, _CMP_LT_OQ) }; }
+			friend Mask<8> operator <= (Lanes const& a, Lanes const& b) noexcept { return { _mm256_cmp_ps(a.m, b.m, _CMP_LE_OQ) }; }
+			friend Mask<8> operator >  (Lanes const& a, Lanes const& b) noexcept { return { _mm256_cmp_ps(a.m, b.m, _CMP_GT_OQ) }; }
+			friend Mask<8> operator >= (Lanes const& a, Lanes const& b) noexcept { return { _mm256_cmp_ps(a.m, b.m, _CMP_GE_OQ) }; }
+			friend Lanes operator - (Lanes const& a) noexcept { return { _mm256_xor_ps(a.m, _mm256_set1_ps(-0.f)) }; }
+			friend Lanes Min(Lanes const& a, Lanes const& b) noexcept { return { _mm256_min_ps(a.m, b.m) }; }
+			friend Lanes Max(Lanes const& a, Lanes const& b) noexcept { return { _mm256_max_ps(a.m, b.m) }; }
+			friend Lanes Sqrt(Lanes const& a) noexcept { return { _mm256_sqrt_ps(a.m) }; }
+			friend Lanes Select(Mask<8> mask, Lanes const& a, Lanes const& b) noexcept { return { _mm256_blendv_ps(b.m, a.m, mask.m) }; }
+		};
+
+#endif
+#if defined(JL_SIMD_AVX512)
+
+		//
+		// AVX-512: 16 lanes
+		//
+
+		template<>
+		struct Mask<16>
+		{
+			__mmask16 m;
+
+			static Mask All() noexcept { return { __mmask16(0xFFFF) }; }
+			static Mask None() noexcept { return { __mmask16(0) }; }
+			static Mask FromBits(uint32_t bits) noexcept { return { __mmask16(bits) }; }
+
+			uint32_t Bits() const noexcept { return uint32_t(m); }
+			bool Any() const noexcept { return m != 0; }
+
+			friend Mask operator & (Mask a, Mask b) noexcept { return { __mmask16(a.m & b.m) }; }
+			friend Mask operator | (Mask a, Mask b) noexcept { return { __mmask16(a.m | b.m) }; }
+			friend Mask AndNot(Mask a, Mask b) noexcept { return { __mmask16(a.m & ~b.m) }; }
+		};
+
+		template<>
+		struct Lanes<16>
+		{
+			__m512 m;
+
+			static Lanes Broadcast(float value) noexcept { return { _mm512_set1_ps(value) }; }
+			static Lanes Load(float const* values) noexcept { return { _mm512_loadu_ps(values) }; }
+			static Lanes LoadBytes(uint8_t const* values) noexcept { return { _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(values)))) }; }
+			void Store(float* values) const noexcept { _mm512_storeu_ps(values, m); }
+
+			friend Lanes operator + (Lanes const& a, Lanes const& b) noexcept { return { _mm512_add_ps(a.m, b.m) }; }
+			friend Lanes operator - (Lanes const& a, Lanes const& b) noexcept { return { _mm512_sub_ps(a.m, b.m) }; }
+			friend Lanes operator * (Lanes const& a, Lanes const& b) noexcept { return { _mm512_mul_ps(a.m, b.m) }; }
+			friend Lanes operator / (Lanes const& a, Lanes const& b) noexcept { return { _mm512_div_ps(a.m, b.m) }; }
+			friend Mask<16> operator <  (Lanes const& a, Lanes const& b) noexcept { return { _mm512_cmp_ps_mask(a.m, b.m, _CMP_LT_OQ) }; }
+			friend Mask<16> operator <= (Lanes const& a, Lanes const& b) noexcept { return { _mm512_cmp_ps_mask(a.m, b.m, _CMP_LE_OQ) }; }
+			friend Mask<16> operator >  (Lanes const& a, Lanes const& b) noexcept { return { _mm512_cmp_ps_mask(a.m, b.m, _CMP_GT_OQ) }; }
+			friend Mask<16> operator >= (Lanes const& a, Lanes const& b) noexcept { return { _mm512_cmp_ps_mask(a.m, b.m, _CMP_GE_OQ) }; }
+			friend Lanes operator - (Lanes const& a) noexcept { return { _mm512_sub_ps(_mm512_setzero_ps(), a.m) }; }
+			friend Lanes Min(Lanes const& a, Lanes const& b) noexcept { return { _mm512_min_ps(a.m, b.m) }; }
+			friend Lanes Max(Lanes const& a, Lanes const& b) noexcept { return { _mm512_max_ps(a.m, b.m) }; }
+			friend Lanes Sqrt(Lanes const& a) noexcept { return { _mm512_sqrt_ps(a.m) }; }
+			friend Lanes Select(Mask<16> mask, Lanes const& a, Lanes const& b) noexcept { return { _mm512_mask_blend_ps(mask.m, b.m, a.m) }; }
+		};
+
+#endif
+
+		//
+		// Width independent helpers
+		//
+
+		template<int W>
+		float ReduceMin(Lanes<W> const& lanes) noexcept
+		{
+			float values[W];
+			lanes.Store(values);
+			return *std::min_element(values, values + W);
+		}
+
+		template<int W>
+		float ReduceMax(Lanes<W> const& lanes) noexcept
+		{
+			float values[W];
+			lanes.Store(values);
+			return *std::max_element(values, values + W);
+		}
+
+		// Number of lanes set in the mask
+		template<int W>
+		int Count(Mask<W> mask) noexcept
+		{
+			int count{};
+			for (uint32_t bits{ mask.Bits() }; bits != 0; bits &= bits - 1)
+				++count;
+			return count;
+		}
+
+		// Calls function(lane) for every lane set in the mask
+		template<int W, typename Function>
+		void ForEachLane(Mask<W> mask, Function&& function)
+		{
+			for (uint32_t bits{ mask.Bits() }; bits != 0; bits &= bits - 1)
+			{
+				int lane{};
+				while (!((bits >> lane) & 1u))
+					++lane;
+				function(lane);
+			}
+		}
+
+		//
+		// Pixel packing
+		//
+
+		// Where the channels of a colour go in a 32 bit pixel, as a byte shuffle of 4 pixels at a time.
+		// shuffle[4 * p + i] is the value byte i (bits 8i to 8i + 7) of pixel p takes from 12 interleaved channel values, or NONE to stay zero
+		struct PixelLayout
+		{
+			static constexpr uint8_t NONE{ 0x80 };
+
+			uint8_t shuffle[16];
+			uint32_t bits; // or'ed into every pixel, an opaque alpha for one
+
+			// channels[i] is the channel (0, 1 or 2) byte i of a pixel takes, or NONE
+			static PixelLayout Make(uint8_t const (&channels)[4], uint32_t bits) noexcept
+			{
+				PixelLayout layout{ {}, bits };
+				for (int pixel{}; pixel < 4; ++pixel)
+					for (int byte{}; byte < 4; ++byte)
+						layout.shuffle[4 * pixel + byte] = channels[byte] == NONE ? NONE : static_cast<uint8_t>(3 * pixel + channels[byte]);
+				return layout;
+			}
+		};
+
+		// Truncates W interleaved colours, 3 * W values within [0, 256), and writes them as W pixels of the layout
+		template<int W>
+		void Pack(Lanes<W> const (&values)[3], PixelLayout const& layout, uint32_t* pixels) noexcept
+		{
+			float channels[3 * W];
+			for (int i{}; i < 3; ++i)
+				values[i].Store(channels + i * W);
+			for (int pixel{}; pixel < W; ++pixel)
+			{
+				uint32_t result{ layout.bits };
+				for (int byte{}; byte < 4; ++byte)
+					if (layout.shuffle[byte] != PixelLayout::NONE)
+						result |= static_cast<uint32_t>(channels[3 * pixel + layout.shuffle[byte]]) << (8 * byte);
+				pixels[pixel] = result;
+			}
+		}
+
+#if defined(JL_SIMD_SSSE3)
+
+		// 4 pixels from 12 interleaved values: narrowed to bytes, then shuffled into place
+		inline __m128i PackFour(__m128i a, __m128i b, __m128i c, PixelLayout const& layout) noexcept
+		{
+			const __m128i bytes{ _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, c)) };
+			const __m128i shuffle{ _mm_loadu_si128(reinterpret_cast<__m128i const*>(layout.shuffle)) };
+			return _mm_or_si128(_mm_shuffle_epi8(bytes, shuffle), _mm_set1_epi32(static_cast<int>(layout.bits)));
+		}
+
+#endif
+#if defined(JL_SIMD_SSE) && defined(JL_SIMD_SSSE3)
+
+		template<>
+		inline void Pack<4>(Lanes<4> const (&values)[3], PixelLayout const& layout, uint32_t* pixels) noexcept
+		{
+			const __m128i packed{ PackFour(_mm_cvttps_epi32(values[0].m), _mm_cvttps_epi32(values[1].m), _mm_cvttps_epi32(values[2].m), layout) };
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels), packed);
+		}
+
+#endif
+#if defined(JL_SIMD_AVX2) && defined(JL_SIMD_SSSE3)
+
+		template<>
+		inline void Pack<8>(Lanes<8> const (&values)[3], PixelLayout const& layout, uint32_t* pixels) noexcept
+		{
+			const __m256i a{ _mm256_cvttps_epi32(values[0].m) };
+			const __m256i b{ _mm256_cvttps_epi32(values[1].m) };
+			const __m256i c{ _mm256_cvttps_epi32(values[2].m) };
+			const __m128i low{ PackFour(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1), _mm256_castsi256_si128(b), layout) };
+			const __m128i high{ PackFour(_mm256_extracti128_si256(b, 1), _mm256_castsi256_si128(c), _mm256_extracti128_si256(c, 1), layout) };
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels), _mm256_set_m128i(high, low));
+		}
+
+#endif
+#if defined(JL_SIMD_AVX512) && defined(JL_SIMD_SSSE3)
+
+		template<>
+		inline void Pack<16>(Lanes<16> const (&values)[3], PixelLayout const& layout, uint32_t* pixels) noexcept
+		{
+			const __m512i a{ _mm512_cvttps_epi32(values[0].m) };
+			const __m512i b{ _mm512_cvttps_epi32(values[1].m) };
+			const __m512i c{ _mm512_cvttps_epi32(values[2].m) };
+			const __m128i quarters[4]{
+				PackFour(_mm512_extracti32x4_epi32(a, 0), _mm512_extracti32x4_epi32(a, 1), _mm512_extracti32x4_epi32(a, 2), layout),
+				PackFour(_mm512_extracti32x4_epi32(a, 3), _mm512_extracti32x4_epi32(b, 0), _mm512_extracti32x4_epi32(b, 1), layout),
+				PackFour(_mm512_extracti32x4_epi32(b, 2), _mm512_extracti32x4_epi32(b, 3), _mm512_extracti32x4_epi32(c, 0), layout),
+				PackFour(_mm512_extracti32x4_epi32(c, 1), _mm512_extracti32x4_epi32(c, 2), _mm512_extracti32x4_epi32(c, 3), layout)
+			};
+			for (int quarter{}; quarter < 4; ++quarter)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels) + quarter, quarters[quarter]);
+		}
+
+#endif
+
+		// Whether the cpu running it can shuffle bytes, which the wider Pack specializations need.
+		// MSVC compiles them in for any x86 target, so only this tells whether they may run
+		inline bool DetectShuffle() noexcept
+		{
+#if defined(JL_SIMD_X86) && defined(_MSC_VER)
+			int info[4]{};
+			__cpuid(info, 1);
+			return (info[2] & (1 << 9)) != 0;
+#elif defined(JL_SIMD_SSSE3)
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		// Widest width both compiled in and supported by the cpu running it
+		inline int DetectWidth() noexcept
+		{
+#if defined(JL_SIMD_X86) && defined(_MSC_VER)
+			int info[4]{};
+			__cpuid(info, 0);
+			const int maxLeaf{ info[0] };
+
+			__cpuid(info, 1);
+			const bool osxsave{ (info[2] & (1 << 27)) != 0 };
+			const bool avx{ (info[2] & (1 << 28)) != 0 };
+			const unsigned long long xcr0{ osxsave ? _xgetbv(0) : 0ull };
+
+			bool avx2{ false }, avx512{ false };
+			if (maxLeaf >= 7)
+			{
+				__cpuidex(info, 7, 0);
+				avx2 = (info[1] & (1 << 5)) != 0;
+				avx512 = (info[1] & (1 << 16)) != 0;
+			}
+
+			if (avx512 && (xcr0 & 0xE6) == 0xE6)
+				return 16;
+			if (avx && avx2 && (xcr0 & 0x6) == 0x6)
+				return 8;
+			return 4;
+#elif defined(__AVX512F__)
+			return 16;
+#elif defined(__AVX2__)
+			return 8;
+#else
+			return 4;
+#endif
+		}
+
+	}
+}
@@ -0,0 +1,80 @@
+// SpaceFillingCurve.h - Positions of grid cells along the Morton and Hilbert curves.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include <cstdint>
+
+namespace JL
+{
+
+	// Smallest power of two of at least value
+	constexpr uint32_t CeilPowerOfTwo(uint32_t value) noexcept
+	{
+		uint32_t result{ 1 };
+		while (result < value)
+			result <<= 1;
+		return result;
+	}
+
+	// Position of cell (x, y) along the Z order curve: the bits of x and y interleaved, x in the even ones.
+	// x and y below 1 << 16
+	constexpr uint32_t MortonIndex(uint32_t x, uint32_t y) noexcept
+	{
+		auto const spread = [](uint32_t value)
+		{
+			value = (value | (value << 8)) & 0x00FF00FF;
+			value = (value | (value << 4)) & 0x0F0F0F0F;
+			value = (value | (value << 2)) & 0x33333333;
+			value = (value | (value << 1)) & 0x55555555;
+			return value;
+		};
+		return spread(x) | (spread(y) << 1);
+	}
+
+	// Position of cell (x, y) along the Hilbert curve through a size x size grid, size a power of two of at most 1 << 16.
+	// Unlike the Z order curve, consecutive cells are always neighbours
+	constexpr uint32_t HilbertIndex(uint32_t x, uint32_t y, uint32_t size) noexcept
+	{
+		uint32_t index{};
+		for (uint32_t half{ size / 2 }; half > 0; half /= 2)
+		{
+			const uint32_t right{ (x & half) != 0 };
+			const uint32_t top{ (y & half) != 0 };
+			index += half * half * ((3 * right) ^ top);
+
+			// rotate the quadrant so the curve within it starts and ends where the outer curve passes through
+			if (top == 0)
+			{
+				if (right == 1)
+				{
+					x = size - 1 - x;
+					y = size - 1 - y;
+				}
+				const uint32_t swap{ x };
+				x = y;
+				y = swap;
+			}
+		}
+		return index;
+	}
+
+}
@@ -0,0 +1,183 @@
+// SphereSet.h - Many spheres of one material, stored and intersected WIDTH at a time.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include "JLBaseIncludes.h"
+#include "JLCircular.h"
+#include "JLBox.h"
+#include "JLBVH.h"
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+namespace JL
+{
+
+	// Particle style geometry: the spheres are grouped into clusters of up to WIDTH neighbours,
+	// each stored in structure of arrays layout so one ray is tested against a whole cluster in one simd iteration (one AVX register of floats).
+	// The clusters go into a BVH of their own, the set is a single object to the scene around it, like a mesh.
+	template<int N, typename T>
+	class SphereSet
+	{
+	public:
+
+		static constexpr int WIDTH{ 8 };
+
+		using Sphere = Circular<N, T>;
+		using Hierarchy = BVH<N, T>;
+		using Index = typename Hierarchy::Index;
+
+		// A cluster that is not filled repeats its last sphere, intersecting it twice changes nothing
+		struct Cluster
+		{
+			alignas(32) T center[N][WIDTH];
+			alignas(32) T squareRadius[WIDTH];
+			Index spheres[WIDTH]; // into GetSpheres()
+		};
+
+		SphereSet() = default;
+
+		explicit SphereSet(std::vector<Sphere> spheres)
+		{
+			SetSpheres(std::move(spheres));
+		}
+
+		// Takes the spheres and builds the clusters and their hierarchy
+		void SetSpheres(std::vector<Sphere> spheres)
+		{
+			m_Spheres = std::move(spheres);
+
+			std::vector<Box<N, T>> bounds{};
+			bounds.reserve(m_Spheres.size());
+			for (Sphere const& sphere : m_Spheres)
+			{
+				Vector<N, T> radius{};
+				for (int axis{}; axis < N; ++axis)
+					radius.data[axis] = sphere.radius;
+				bounds.push_back(Box<N, T>{ sphere.center - radius, sphere.center + radius });
+			}
+
+			// Every subtree of a hierarchy over the single spheres holds a contiguous range of its indices.
+			// The largest subtrees of at most WIDTH spheres become the clusters, they are as tight as the hierarchy's nodes
+
+			Hierarchy single{};
+			single.Build(bounds);
+			auto const& nodes{ single.GetNodes() };
+			auto const& indices{ single.GetIndices() };
+
+			std::vector<std::pair<Index, Index>> ranges(nodes.size()); // first index and count below every node
+			for (size_t index{ nodes.size() }; index-- > 0;)
+			{
+				auto const& node{ nodes[index] };
+				if (node.IsLeaf())
+					ranges[index] = { node.offset, node.count };
+				else
+					ranges[index] = { ranges[index + 1].first, ranges[index + 1].second + ranges[node.offset].second };
+			}
+
+			// Subtrees in depth first order, neighbouring ones share a cluster as long as they fit together
+			std::vector<std::pair<Index, Index>> groups{};
+			m_Bounds.clear();
+			std::vector<Index> stack{};
+			if (!nodes.empty())
+				stack.push_back(0);
+			while (!stack.empty())
+			{
+				const Index index{ stack.back() };
+				stack.pop_back();
+				auto const [first, count] { ranges[index] };
+				if (count > static_cast<Index>(WIDTH) && !nodes[index].IsLeaf())
+				{
+					stack.push_back(nodes[index].offset);
+					stack.push_back(index + 1);
+				}
+				else if (count > static_cast<Index>(WIDTH))
+				{
+					// a leaf the hierarchy could not split (coinciding centres, its depth limit) fills clusters of its own
+					for (Index skipped{}; skipped < count; skipped += static_cast<Index>(WIDTH))
+					{
+						groups.emplace_back(first + skipped, std::min(static_cast<Index>(WIDTH), count - skipped));
+						m_Bounds.push_back(nodes[index].bounds);
+					}
+				}
+				else if (!groups.empty() && groups.back().second + count <= static_cast<Index>(WIDTH))
+				{
+					groups.back().second += count;
+					m_Bounds.back().Grow(nodes[index].bounds);
+				}
+				else
+				{
+					groups.emplace_back(first, count);
+					m_Bounds.push_back(nodes[index].bounds);
+				}
+			}
+
+			m_Clusters.resize(groups.size());
+			for (size_t group{}; group < groups.size(); ++group)
+			{
+				auto const [first, count] { groups[group] };
+				Cluster& cluster{ m_Clusters[group] };
+				for (Index lane{}; lane < static_cast<Index>(WIDTH); ++lane)
+				{
+					const Index sphere{ indices[first + std::min(lane, count - 1)] };
+					for (int axis{}; axis < N; ++axis)
+						cluster.center[axis][lane] = m_Spheres[sphere].center.data[axis];
+					cluster.squareRadius[lane] = m_Spheres[sphere].radius * m_Spheres[sphere].radius;
+					cluster.spheres[lane] = sphere;
+				}
+			}
+			m_Hierarchy.Build(m_Bounds);
+		}
+
+		// In the order they were given in
+		std::vector<Sphere> const& GetSpheres() const noexcept
+		{
+			return m_Spheres;
+		}
+
+		std::vector<Cluster> const& GetClusters() const noexcept
+		{
+			return m_Clusters;
+		}
+
+		// One per cluster, in the same order
+		std::vector<Box<N, T>> const& GetBounds() const noexcept
+		{
+			return m_Bounds;
+		}
+
+		// Over the clusters
+		Hierarchy const& GetHierarchy() const noexcept
+		{
+			return m_Hierarchy;
+		}
+
+	private:
+
+		std::vector<Sphere> m_Spheres;
+		std::vector<Cluster> m_Clusters;
+		std::vector<Box<N, T>> m_Bounds;
+		Hierarchy m_Hierarchy;
+
+	};
+
+}
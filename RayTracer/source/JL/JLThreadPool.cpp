@@ -0,0 +1,111 @@
+#include "JLThreadPool.h"
+#include <algorithm>
+
+namespace JL
+{
+
+	ThreadPool::ThreadPool(size_t workers)
+		: m_Threads{}
+		, m_Queues{ std::make_unique<Queue[]>(std::max<size_t>(workers, 1)) }
+		, m_Job{}
+		, m_Generation{ 0 }
+		, m_Busy{ 0 }
+		, m_Stop{ false }
+	{
+		for (size_t worker{ 1 }; worker < std::max<size_t>(workers, 1); ++worker)
+			m_Threads.emplace_back(&ThreadPool::Worker, this, worker);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			m_Stop = true;
+		}
+		m_Start.notify_all();
+		for (std::thread& thread : m_Threads)
+			thread.join();
+	}
+
+	void ThreadPool::Run(size_t count, Job&& job)
+	{
+		if (count == 0)
+			return;
+
+		const size_t workers{ GetWorkerCount() };
+		for (size_t index{}; index < count; ++index)
+			m_Queues[index * workers / count].tasks.push_back(index);
+
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			m_Job = std::move(job);
+			m_Busy = m_Threads.size();
+			++m_Generation;
+		}
+		m_Start.notify_all();
+
+		Work(0);
+
+		std::unique_lock<std::mutex> lock{ m_Mutex };
+		m_Done.wait(lock, [this]() { return m_Busy == 0; });
+		m_Job = nullptr;
+	}
+
+	void ThreadPool::Worker(size_t worker)
+	{
+		size_t generation{ 0 };
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock{ m_Mutex };
+				m_Start.wait(lock, [this, generation]() { return m_Stop || m_Generation != generation; });
+				if (m_Stop)
+					return;
+				generation = m_Generation;
+			}
+
+			Work(worker);
+
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			if (--m_Busy == 0)
+				m_Done.notify_one();
+		}
+	}
+
+	void ThreadPool::Work(size_t worker)
+	{
+		size_t task{};
+		while (Pop(worker, task))
+			m_Job(task, worker);
+	}
+
+	bool ThreadPool::Pop(size_t worker, size_t& task)
+	{
+		{
+			Queue& own{ m_Queues[worker] };
+			std::lock_guard<std::mutex> lock{ own.mutex };
+			if (!own.tasks.empty())
+			{
+				task = own.tasks.front();
+				own.tasks.pop_front();
+				return true;
+			}
+		}
+
+		const size_t workers{ GetWorkerCount() };
+		for (size_t offset{ 1 }; offset < workers; ++offset)
+		{
+			Queue& other{ m_Queues[(worker + offset) % workers] };
+			std::lock_guard<std::mutex> lock{ other.mutex };
+			if (!other.tasks.empty())
+			{
+				task = other.tasks.back();
+				other.tasks.pop_back();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+}
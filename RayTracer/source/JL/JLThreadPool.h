@@ -0,0 +1,92 @@
+// ThreadPool.h - Work stealing thread pool for data parallel loops.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+
+namespace JL
+{
+
+	// Every worker gets a contiguous share of the indices in its own queue.
+	// Workers that run out steal from the back of another worker's queue.
+	// The calling thread takes part as worker 0.
+
+	class ThreadPool final
+	{
+	public:
+
+		using Job = std::function<void(size_t /*index*/, size_t /*worker*/)>;
+
+		explicit ThreadPool(size_t workers = std::thread::hardware_concurrency());
+		~ThreadPool();
+
+		ThreadPool(ThreadPool const&) = delete;
+		ThreadPool(ThreadPool&&) = delete;
+		ThreadPool& operator = (ThreadPool const&) = delete;
+		ThreadPool& operator = (ThreadPool&&) = delete;
+
+		// Includes the calling thread
+		size_t GetWorkerCount() const noexcept
+		{
+			return m_Threads.size() + 1;
+		}
+
+		// Calls function(index, worker) for every index in [0, count), returns once all are done.
+		template<typename Function>
+		void ParallelFor(size_t count, Function const& function)
+		{
+			Run(count, Job{ [&function](size_t index, size_t worker) { function(index, worker); } });
+		}
+
+	private:
+
+		struct Queue
+		{
+			std::mutex mutex;
+			std::deque<size_t> tasks;
+		};
+
+		std::vector<std::thread> m_Threads;
+		std::unique_ptr<Queue[]> m_Queues;
+
+		Job m_Job;
+		std::mutex m_Mutex;
+		std::condition_variable m_Start;
+		std::condition_variable m_Done;
+		size_t m_Generation;
+		size_t m_Busy;
+		bool m_Stop;
+
+		void Run(size_t count, Job&& job);
+		void Worker(size_t worker);
+		void Work(size_t worker);
+		bool Pop(size_t worker, size_t& task);
+
+	};
+
+}
@@ -0,0 +1,631 @@
+// WideBVH.h - Bounding volume hierarchy of W children per node, with their bounds quantized to bytes.
+
+/* Copyright (C) 2020 Kobe Vrijsen
+
+   this file is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3.0 of the License, or (at your option) any later version.
+
+   This file is made available in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see
+   <https://www.gnu.org/licenses/>.
+
+   Information in regards to this file:
+   Contact:   kobevrijsen@posteo.be
+*/
+
+#pragma once
+#include "JLBaseIncludes.h"
+#include "JLBox.h"
+#include "JLBVH.h"
+#include "JLLine.h"
+#include "JLSimd.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <thread>
+#include <type_traits>
+
+namespace JL
+{
+
+	// A binary BVH collapsed into nodes of up to W children, the binary nodes with the largest surface area are opened first.
+	// Leaves are not nodes of their own: a node's child is either another node or a range of at most BVH::MAX_LEAF_SIZE primitives.
+	// The few binary leaves that end up larger (coinciding centroids, the depth limit) are spread over nodes of their own.
+	// Child bounds are stored as bytes on a grid over their parent's bounds, with power of two cells so decoding is exact, rounded outwards.
+	// A ray tests all children of a node in one simd operation: W = 4 takes SSE, which every x64 cpu has; 8 and 16 need AVX2 and AVX-512.
+	// Same interface as BVH: build from primitive bounds, refit, restore and traverse with the same callables.
+	template<int N, typename T, int W = 4>
+	class WideBVH
+	{
+	public:
+
+		static_assert(std::is_same_v<T, float>, "Children are tested in float lanes");
+
+		using Value = T;
+		using Box = Box<N, T>;
+		using Binary = BVH<N, T>;
+		using Index = typename Binary::Index;
+		using Lanes = simd::Lanes<W>;
+
+		static constexpr int WIDTH{ W };
+		static constexpr uint8_t INTERIOR{ 0 };  // child count of a child that is a node
+		static constexpr uint8_t EMPTY{ 0xFF };  // child count of an unused slot
+		static constexpr uint8_t CELLS{ 0xFF };  // along every axis of a node
+		static constexpr uint8_t MAX_LEAF_COUNT{ EMPTY - 1 }; // the count byte also holds INTERIOR and EMPTY
+		// The binary tree's depth, plus the node levels the largest possible leaf is spread over
+		static constexpr size_t STACK_SIZE = (Binary::STACK_SIZE + []()
+			{
+				size_t depth{};
+				for (uint64_t count{ std::numeric_limits<Index>::max() }; count > MAX_LEAF_COUNT; count = (count + W - 1) / W)
+					++depth;
+				return depth;
+			}()) * (W - 1);
+		// Deepest node traversal has stack for: every node visited pops one entry and pushes up to W
+		static constexpr size_t MAX_DEPTH = STACK_SIZE / (W - 1) - 2;
+		static constexpr size_t PARALLEL_REFIT_NODES = Binary::PARALLEL_REFIT_NODES / (W - 1); // a binary tree over as many primitives
+		static constexpr T TRAVERSAL_COST = Binary::TRAVERSAL_COST;
+		static constexpr T INTERSECTION_COST = Binary::INTERSECTION_COST;
+
+		struct alignas(64) Node
+		{
+			T origin[N];             // of the cells, the low corner of the node's bounds
+			int8_t exponent[N];      // cells are 2^exponent wide
+			uint8_t counts[W];       // per child: primitives in the leaf, INTERIOR or EMPTY
+			uint8_t low[N][W];       // child bounds in cells from the origin
+			uint8_t high[N][W];
+			Index children[W];       // interior: node index, leaf: first primitive index
+
+			bool IsEmpty(int child) const noexcept
+			{
+				return counts[child] == EMPTY;
+			}
+
+			bool IsLeaf(int child) const noexcept
+			{
+				return counts[child] != INTERIOR && counts[child] != EMPTY;
+			}
+
+			// Exactly as traversal sees them: never smaller than what was quantized
+			Box GetBounds(int child) const noexcept
+			{
+				Box bounds{};
+				for (int axis{}; axis < N; ++axis)
+				{
+					const T size{ Power(exponent[axis]) };
+					bounds.min.data[axis] = origin[axis] + static_cast<T>(low[axis][child]) * size;
+					bounds.max.data[axis] = origin[axis] + static_cast<T>(high[axis][child]) * size;
+				}
+				return bounds;
+			}
+
+			// Of every child at once, empty ones included
+			void GetBounds(T (&min)[N][W], T (&max)[N][W]) const noexcept
+			{
+				for (int axis{}; axis < N; ++axis)
+				{
+					const Lanes size{ Lanes::Broadcast(Power(exponent[axis])) };
+					const Lanes start{ Lanes::Broadcast(origin[axis]) };
+					(start + Lanes::LoadBytes(low[axis]) * size).Store(min[axis]);
+					(start + Lanes::LoadBytes(high[axis]) * size).Store(max[axis]);
+				}
+			}
+		};
+
+		WideBVH() = default;
+
+		// Subtrees of up to leafSize primitives become a single leaf, which keeps nodes full down to the bottom.
+		// 1 keeps the leaves as built, for primitives that cost a lot more to intersect than a box
+		void Build(std::vector<Box> const& bounds, Index leafSize = Binary::MAX_LEAF_SIZE)
+		{
+			Binary binary{};
+			binary.Build(bounds);
+			Collapse(binary, std::min(leafSize, static_cast<Index>(MAX_LEAF_COUNT)));
+			m_BuildCost = m_Cost = Cost();
+		}
+
+		// Takes nodes and indices as returned by GetNodes and GetIndices of a hierarchy built before, over primitiveCount primitives.
+		// Returns false, leaving the hierarchy empty, when they do not form a valid tree.
+		bool Restore(std::vector<Node> nodes, std::vector<Index> indices, Index primitiveCount)
+		{
+			m_Nodes = std::move(nodes);
+			m_Indices = std::move(indices);
+
+			bool valid{ m_Indices.size() == primitiveCount && m_Nodes.empty() == m_Indices.empty() };
+			std::vector<bool> seen(primitiveCount);
+			for (Index index : m_Indices)
+			{
+				valid &= index < primitiveCount && !seen[index];
+				if (valid)
+					seen[index] = true;
+			}
+
+			// Every node is the child of exactly one other but the root, no deeper than traversal has stack for,
+			// and every index is in exactly one leaf
+			std::vector<bool> parented(m_Nodes.size());
+			std::vector<size_t> depths(m_Nodes.size());
+			std::vector<bool> covered(m_Indices.size());
+			Index coveredCount{};
+			for (Index index{}; valid && index < m_Nodes.size(); ++index)
+			{
+				Node const& node{ m_Nodes[index] };
+				valid = parented[index] == (index != 0) && std::any_of(std::begin(node.counts), std::end(node.counts), [](uint8_t count) { return count != EMPTY; });
+				for (int child{}; valid && child < W; ++child)
+				{
+					if (node.IsEmpty(child))
+						continue;
+					const Index target{ node.children[child] };
+					if (node.IsLeaf(child))
+					{
+						valid = target <= m_Indices.size() && node.counts[child] <= m_Indices.size() - target;
+						for (Index i{ target }; valid && i < target + node.counts[child]; ++i)
+						{
+							valid = !covered[i];
+							covered[i] = true;
+						}
+						coveredCount += node.counts[child];
+					}
+					else
+					{
+						valid = target > index && target < m_Nodes.size() && !parented[target] && depths[index] < MAX_DEPTH; // children come after their parent
+						if (valid)
+						{
+							parented[target] = true;
+							depths[target] = depths[index] + 1;
+						}
+					}
+				}
+			}
+			valid &= coveredCount == m_Indices.size();
+
+			if (!valid)
+			{
+				Clear();
+				return false;
+			}
+			m_Bounds = RootBounds();
+			m_BuildCost = m_Cost = Cost();
+			return true;
+		}
+
+		// Updates the child bounds to primitives that moved, keeping the tree as it is. The primitive count has to be the same.
+		// Returns the ratio of its current SAH cost to its cost when built, see BVH::Refit
+		T Refit(std::vector<Box> const& bounds)
+		{
+			if (m_Nodes.empty())
+				return static_cast<T>(1);
+
+			// Large trees refit the subtrees under the root concurrently, each bottom up on its own, and the root after
+			Node& root{ m_Nodes.front() };
+			if (m_Nodes.size() < PARALLEL_REFIT_NODES || std::thread::hardware_concurrency() < 2)
+				RefitSubtree(bounds, 0);
+			else
+			{
+				Box children[W]{};
+				std::future<Box> jobs[W]{};
+				for (int child{}; child < W; ++child)
+					if (!root.IsEmpty(child) && !root.IsLeaf(child))
+						jobs[child] = std::async(std::launch::async, [this, &bounds, index = root.children[child]]() { return RefitSubtree(bounds, index); });
+				for (int child{}; child < W; ++child)
+				{
+					if (jobs[child].valid())
+						children[child] = jobs[child].get();
+					else if (root.IsLeaf(child))
+						children[child] = LeafBounds(bounds, root, child);
+				}
+				Quantize(root, children);
+			}
+
+			m_Bounds = RootBounds();
+			m_Cost = Cost();
+			return GetDegradation();
+		}
+
+		// Expected cost of a ray through the root by the surface area heuristic, see BVH::Cost
+		T Cost() const noexcept
+		{
+			if (m_Nodes.empty())
+				return static_cast<T>(0);
+
+			const T rootArea{ m_Bounds.HalfArea() };
+			if (rootArea <= static_cast<T>(0))
+				return INTERSECTION_COST * static_cast<T>(m_Indices.size());
+
+			T cost{};
+			for (Node const& node : m_Nodes)
+				for (int child{}; child < W; ++child)
+					if (!node.IsEmpty(child))
+						cost += node.GetBounds(child).HalfArea() * (node.IsLeaf(child) ? INTERSECTION_COST * static_cast<T>(node.counts[child]) : TRAVERSAL_COST);
+			return (cost + rootArea * TRAVERSAL_COST) / rootArea;
+		}
+
+		T GetDegradation() const noexcept
+		{
+			return m_BuildCost > static_cast<T>(0) ? m_Cost / m_BuildCost : static_cast<T>(1);
+		}
+
+		void Clear() noexcept
+		{
+			m_Nodes.clear();
+			m_Indices.clear();
+			m_Bounds = Box{};
+			m_BuildCost = m_Cost = static_cast<T>(0);
+		}
+
+		bool IsEmpty() const noexcept
+		{
+			return m_Nodes.empty();
+		}
+
+		// The union of the root's children as stored
+		Box const& GetBounds() const noexcept
+		{
+			return m_Bounds;
+		}
+
+		std::vector<Node> const& GetNodes() const noexcept
+		{
+			return m_Nodes;
+		}
+
+		std::vector<Index> const& GetIndices() const noexcept
+		{
+			return m_Indices;
+		}
+
+		// The cells move along, their contents stay the same
+		void Translate(Vector<N, T> const& translation) noexcept
+		{
+			for (Node& node : m_Nodes)
+				for (int axis{}; axis < N; ++axis)
+					node.origin[axis] += translation.data[axis];
+			m_Bounds = RootBounds();
+		}
+
+		// Same contract as BVH::Traverse, visits children front to back
+		template<bool anyHit = false, typename Hit>
+		bool Traverse(Line<N, T> const& line, T const& tMin, T tMax, Hit&& hit) const
+		{
+			if (m_Nodes.empty())
+				return false;
+
+			// A zero direction would turn the cell steps into nan, a tiny one keeps the slab on the right side of the origin
+			Vector<N, T> inverse{};
+			for (int axis{}; axis < N; ++axis)
+			{
+				const T direction{ line.direction.data[axis] };
+				const T tiny{ static_cast<T>(1e-18) };
+				inverse.data[axis] = static_cast<T>(1) / (std::abs(direction) < tiny ? std::copysign(tiny, direction) : direction);
+			}
+
+			struct Entry
+			{
+				Index child; // node or first primitive
+				uint32_t count;
+				T t;
+			} stack[STACK_SIZE];
+			size_t size{};
+
+			T entry{};
+			if (!Intersect(entry, line.origin, inverse, m_Bounds, tMin, tMax))
+				return false;
+			stack[size++] = { 0, INTERIOR, entry };
+
+			bool found{ false };
+			while (size != 0)
+			{
+				const Entry current{ stack[--size] };
+				if (current.t > tMax)
+					continue;
+
+				if (current.count != INTERIOR)
+				{
+					for (Index i{ current.child }; i < current.child + current.count; ++i)
+					{
+						if (hit(m_Indices[i], tMin, tMax))
+						{
+							found = true;
+							if constexpr (anyHit)
+								return true;
+						}
+					}
+					continue;
+				}
+
+				Node const& node{ m_Nodes[current.child] };
+				TraversalCounter::CountVisit(&node);
+
+				// every child's slabs at once: origin + cell * size along the line is cell * (size / direction) + (origin - line origin) / direction
+				Lanes near{ Lanes::Broadcast(tMin) };
+				Lanes far{ Lanes::Broadcast(tMax) };
+				for (int axis{}; axis < N; ++axis)
+				{
+					const Lanes step{ Lanes::Broadcast(inverse.data[axis] * Power(node.exponent[axis])) };
+					const Lanes start{ Lanes::Broadcast((node.origin[axis] - line.origin.data[axis]) * inverse.data[axis]) };
+					const Lanes t0{ Lanes::LoadBytes(node.low[axis]) * step + start };
+					const Lanes t1{ Lanes::LoadBytes(node.high[axis]) * step + start };
+					near = Max(near, Min(t0, t1));
+					far = Min(far, Max(t0, t1));
+				}
+
+				uint32_t bits{ (near <= far).Bits() };
+				if (bits == 0)
+					continue;
+				T entries[W];
+				near.Store(entries);
+
+				// onto the stack nearest last, so it is popped first
+				const size_t first{ size };
+				for (; bits != 0; bits &= bits - 1)
+				{
+					const int child{ CountTrailingZeros(bits) };
+					if (node.IsEmpty(child))
+						continue;
+					Entry const pushed{ node.children[child], node.counts[child], entries[child] };
+					size_t at{ size++ };
+					for (; at > first && stack[at - 1].t < pushed.t; --at)
+						stack[at] = stack[at - 1];
+					stack[at] = pushed;
+				}
+			}
+
+			return found;
+		}
+
+	private:
+
+		std::vector<Node> m_Nodes;
+		std::vector<Index> m_Indices;
+		Box m_Bounds{};
+		T m_BuildCost{};
+		T m_Cost{};
+
+		// Cell sizes are normal floats
+		static constexpr int MIN_EXPONENT{ std::numeric_limits<T>::min_exponent - 1 };
+		static constexpr int MAX_EXPONENT{ std::numeric_limits<T>::max_exponent - 1 };
+
+		// 2^exponent, built from its bits
+		static T Power(int exponent) noexcept
+		{
+			const uint32_t bits{ static_cast<uint32_t>(exponent + 127) << 23 };
+			T value;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		static int CountTrailingZeros(uint32_t bits) noexcept
+		{
+			int count{};
+			while ((bits & 1u) == 0)
+			{
+				bits >>= 1;
+				++count;
+			}
+			return count;
+		}
+
+		Box RootBounds() const noexcept
+		{
+			Box bounds{};
+			if (!m_Nodes.empty())
+				for (int child{}; child < W; ++child)
+					if (!m_Nodes.front().IsEmpty(child))
+						bounds.Grow(m_Nodes.front().GetBounds(child));
+			return bounds;
+		}
+
+		void Collapse(Binary const& binary, Index leafSize)
+		{
+			m_Nodes.clear();
+			m_Indices = binary.GetIndices();
+			m_Bounds = Box{};
+			if (binary.IsEmpty())
+				return;
+
+			// Every subtree holds a contiguous range of the indices
+			auto const& nodes{ binary.GetNodes() };
+			std::vector<Range> ranges(nodes.size());
+			for (size_t index{ nodes.size() }; index-- > 0;)
+			{
+				auto const& node{ nodes[index] };
+				if (node.IsLeaf())
+					ranges[index] = { node.offset, node.count };
+				else
+					ranges[index] = { ranges[index + 1].first, ranges[index + 1].count + ranges[node.offset].count };
+			}
+
+			m_Nodes.reserve(nodes.size() / W + 1);
+			Emit(binary, ranges, leafSize, 0);
+			m_Bounds = RootBounds();
+		}
+
+		struct Range
+		{
+			Index first;
+			Index count;
+		};
+
+		// Makes a node of the binary node's descendants: the one with the largest area is opened up into its two children until there are W.
+		// Subtrees of up to leafSize primitives are not opened. Returns the node's index, its descendants follow it
+		Index Emit(Binary const& binary, std::vector<Range> const& ranges, Index leafSize, Index root)
+		{
+			auto const& nodes{ binary.GetNodes() };
+			auto const opens = [&nodes, &ranges, leafSize](Index index) { return !nodes[index].IsLeaf() && ranges[index].count > leafSize; };
+
+			Index children[W]{ root };
+			int count{ 1 };
+			while (count < W)
+			{
+				int largest{ -1 };
+				for (int child{}; child < count; ++child)
+					if (opens(children[child]) && (largest < 0 || nodes[children[child]].bounds.HalfArea() > nodes[children[largest]].bounds.HalfArea()))
+						largest = child;
+				if (largest < 0)
+					break;
+				const Index opened{ children[largest] };
+				children[largest] = opened + 1;
+				children[count++] = nodes[opened].offset;
+			}
+
+			const Index index{ static_cast<Index>(m_Nodes.size()) };
+			m_Nodes.emplace_back();
+
+			Index slots[W]{};
+			uint8_t counts[W]{};
+			Box bounds[W]{};
+			for (int child{}; child < W; ++child)
+			{
+				if (child >= count)
+				{
+					counts[child] = EMPTY;
+					continue;
+				}
+				bounds[child] = nodes[children[child]].bounds;
+				if (opens(children[child]))
+				{
+					slots[child] = Emit(binary, ranges, leafSize, children[child]);
+					counts[child] = INTERIOR;
+				}
+				else if (ranges[children[child]].count > MAX_LEAF_COUNT)
+				{
+					slots[child] = Spread(ranges[children[child]], bounds[child]);
+					counts[child] = INTERIOR;
+				}
+				else
+				{
+					slots[child] = ranges[children[child]].first;
+					counts[child] = static_cast<uint8_t>(ranges[children[child]].count);
+				}
+			}
+
+			Node& node{ m_Nodes[index] };
+			std::copy(std::begin(slots), std::end(slots), std::begin(node.children));
+			std::copy(std::begin(counts), std::end(counts), std::begin(node.counts));
+			Quantize(node, bounds);
+			return index;
+		}
+
+		// Makes a node of a binary leaf too large for one child: its range is cut into W parts, each a leaf again or spread further.
+		// The primitives cannot be told apart by their centroids, every part keeps the leaf's bounds. Returns the node's index
+		Index Spread(Range range, Box const& bounds)
+		{
+			const Index index{ static_cast<Index>(m_Nodes.size()) };
+			m_Nodes.emplace_back();
+
+			const Index share{ (range.count + W - 1) / W };
+			Index slots[W]{};
+			uint8_t counts[W]{};
+			Box parts[W]{};
+			for (int child{}; child < W; ++child)
+			{
+				const Index skipped{ share * static_cast<Index>(child) };
+				if (skipped >= range.count)
+				{
+					counts[child] = EMPTY;
+					continue;
+				}
+				const Range part{ range.first + skipped, std::min(share, range.count - skipped) };
+				parts[child] = bounds;
+				if (part.count > MAX_LEAF_COUNT)
+				{
+					slots[child] = Spread(part, bounds);
+					counts[child] = INTERIOR;
+				}
+				else
+				{
+					slots[child] = part.first;
+					counts[child] = static_cast<uint8_t>(part.count);
+				}
+			}
+
+			Node& node{ m_Nodes[index] };
+			std::copy(std::begin(slots), std::end(slots), std::begin(node.children));
+			std::copy(std::begin(counts), std::end(counts), std::begin(node.counts));
+			Quantize(node, parts);
+			return index;
+		}
+
+		Box LeafBounds(std::vector<Box> const& bounds, Node const& node, int child) const noexcept
+		{
+			Box result{};
+			for (Index i{ node.children[child] }; i < node.children[child] + node.counts[child]; ++i)
+				result.Grow(bounds[m_Indices[i]]);
+			return result;
+		}
+
+		// Refits the node at index and everything below it, returns the node's bounds. Recurses at most MAX_DEPTH deep
+		Box RefitSubtree(std::vector<Box> const& bounds, Index index) noexcept
+		{
+			Node& node{ m_Nodes[index] };
+			Box children[W]{};
+			for (int child{}; child < W; ++child)
+			{
+				if (node.IsLeaf(child))
+					children[child] = LeafBounds(bounds, node, child);
+				else if (!node.IsEmpty(child))
+					children[child] = RefitSubtree(bounds, node.children[child]);
+			}
+			return Quantize(node, children);
+		}
+
+		// Stores the children's bounds into the node, empty slots get none. Returns the node's bounds
+		static Box Quantize(Node& node, Box const (&children)[W]) noexcept
+		{
+			Box bounds{};
+			for (int child{}; child < W; ++child)
+				if (!node.IsEmpty(child))
+					bounds.Grow(children[child]);
+
+			for (int axis{}; axis < N; ++axis)
+			{
+				// the smallest power of two cells that covers the extent
+				const T origin{ bounds.min.data[axis] };
+				const T extent{ bounds.max.data[axis] - origin };
+				int exponent{ MIN_EXPONENT };
+				if (extent > static_cast<T>(0))
+					std::frexp(extent / static_cast<T>(CELLS), &exponent);
+				exponent = std::clamp(exponent, MIN_EXPONENT, MAX_EXPONENT);
+				while (exponent < MAX_EXPONENT && origin + static_cast<T>(CELLS) * Power(exponent) < bounds.max.data[axis])
+					++exponent;
+				const T size{ Power(exponent) };
+
+				node.origin[axis] = origin;
+				node.exponent[axis] = static_cast<int8_t>(exponent);
+				for (int child{}; child < W; ++child)
+				{
+					if (node.IsEmpty(child))
+					{
+						node.low[axis][child] = CELLS;
+						node.high[axis][child] = 0;
+						continue;
+					}
+
+					// rounded outwards, then checked the way it is decoded
+					T low{ std::floor((children[child].min.data[axis] - origin) / size) };
+					T high{ std::ceil((children[child].max.data[axis] - origin) / size) };
+					low = std::clamp(low, static_cast<T>(0), static_cast<T>(CELLS));
+					high = std::clamp(high, static_cast<T>(0), static_cast<T>(CELLS));
+					while (low > 0 && origin + low * size > children[child].min.data[axis])
+						--low;
+					while (high < CELLS && origin + high * size < children[child].max.data[axis])
+						++high;
+					node.low[axis][child] = static_cast<uint8_t>(low);
+					node.high[axis][child] = static_cast<uint8_t>(high);
+				}
+			}
+			return bounds;
+		}
+
+	};
+
+}
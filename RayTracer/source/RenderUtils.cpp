@@ -1,5 +1,29 @@
 #include "RenderUtils.h"
 
+void Elite::Scene::BuildHierarchy()
+{
+	hierarchy.Build(objects, acceleration);
+
+	// Lights by how bright their brightest channel is
+	auto const power = [](auto const& source)
+	{
+		return source.intensity * std::max(source.colour.r, std::max(source.colour.g, source.colour.b));
+	};
+
+	std::vector<WorldPoint> positions{};
+	std::vector<WorldValue> powers{};
+	for (WorldObject<PointLight> const& source : lights.Get<WorldObject<PointLight>>())
+	{
+		positions.push_back(source.position);
+		powers.push_back(power(source));
+	}
+	std::vector<WorldValue> distantPowers{};
+	for (WorldObject<DirectionalLight> const& source : lights.Get<WorldObject<DirectionalLight>>())
+		distantPowers.push_back(power(source));
+
+	lightHierarchy.Build(positions, powers, distantPowers);
+}
+
 Elite::NDCPoint& Elite::RasterToNCD(NDCPoint& result, const RasterPoint value, const RasterValue width, const RasterValue height)
 {
 	result.x = static_cast<NDCValue>(value.x) / static_cast<NDCValue>(width);
@@ -44,39 +68,28 @@ Elite::RasterPoint Elite::ScreenToRaster(const ScreenPoint value, const RasterVa
 	};
 }
 
-Elite::WorldVector Elite::GetNormal(ObjectContainer::PtrVariant const& object, WorldPoint const& hitPoint, Intersection const& intersectionResult, WorldVector const& view)
+Elite::WorldVector Elite::GetNormal(ObjectHierarchy const& objects, ObjectHierarchy::Primitive const& primitive, WorldPoint const& hitPoint, Intersection const& intersectionResult, WorldVector const& view)
 {
-	return std::visit(
-		JL::Visitor{
-			[](WorldObject<Plane> const* plane)
-			{
-				return plane->normal;
-			},
-			[&hitPoint](WorldObject<Sphere> const* sphere)
-			{
-				return hitPoint - sphere->center;
-			},
-			[&intersectionResult, &view](WorldObject<Mesh> const*)
-			{
-				auto const& triangle = *static_cast<Mesh::MeshData::Triangle const*>(intersectionResult.hitFace);
-				auto const normal = Plane{ *triangle.x, *triangle.y, *triangle.z }.normal;
-				if (Dot(normal, view) > 0)
-					return -normal;
-				else
-					return normal;
-			},
-		},
-		object
-	);
-}
+	// Triangle normals face the viewer
+	auto const facing = [&view](WorldVector const& normal)
+	{
+		if (Dot(normal, view) > 0)
+			return -normal;
+		else
+			return normal;
+	};
 
-Elite::SurfaceData const& Elite::GetSurfaceData(ObjectContainer::PtrVariant const& object)
-{
-	return std::visit(
-		[](auto const* object) -> SurfaceData const&
-		{
-			return *object;
-		},
-		object
-	);
-}
\ No newline at end of file
+	switch (primitive.GetType())
+	{
+	case ObjectHierarchy::TYPE<WorldObject<Plane>>:
+		return objects.GetGeometry<WorldObject<Plane>>(primitive).normal;
+	case ObjectHierarchy::TYPE<WorldObject<Sphere>>:
+		return hitPoint - objects.GetGeometry<WorldObject<Sphere>>(primitive).center;
+	case ObjectHierarchy::TYPE<WorldObject<Mesh>>:
+		return facing(static_cast<Mesh::Record const*>(intersectionResult.hitFace)->normal);
+	case ObjectHierarchy::TYPE<WorldObject<SphereSet>>:
+		return hitPoint - static_cast<Sphere const*>(intersectionResult.hitFace)->center;
+	default:
+		return facing(objects.GetGeometry<WorldObject<MeshInstance>>(primitive).NormalToWorld(static_cast<Mesh::Record const*>(intersectionResult.hitFace)->normal));
+	}
+}
@@ -49,7 +49,15 @@ namespace Elite
 	using DirectionalLight = JL::DirectionalLight<DIMENTIONS, WorldValue>;
 	using Camera           = JL::Camera          <DIMENTIONS, WorldValue>;
 	using Mesh             = JL::Mesh            <DIMENTIONS, WorldValue>;
+	using MeshInstance     = JL::MeshInstance    <DIMENTIONS, WorldValue>;
+	using SphereSet        = JL::SphereSet       <DIMENTIONS, WorldValue>;
 	using Triangle         = Mesh::MeshData::Triangle;
+	using Box              = JL::Box             <DIMENTIONS, WorldValue>;
+
+	template<int W>
+	using RayPacket          = JL::RayPacket         <DIMENTIONS, W>;
+	template<int W>
+	using PacketIntersection = JL::PacketIntersection<W>;
 
 	template<typename Object>
 	//using WorldObject = Coloured<Object, COLOURS, ColourValue, Vector>;
@@ -58,17 +66,38 @@ namespace Elite
 	using ObjectContainer      = JL::VectorTuple<
 		WorldObject<Plane >,
 		WorldObject<Sphere>,
-		WorldObject<Mesh  >
+		WorldObject<Mesh  >,
+		WorldObject<MeshInstance>,
+		WorldObject<SphereSet>
 	>;
 	using LightsourceContainer = JL::VectorTuple<
 		WorldObject<PointLight      >,
 		WorldObject<DirectionalLight>
 	>;
 
+	using ObjectHierarchy = JL::ObjectHierarchy<DIMENTIONS, WorldValue, ObjectContainer, SurfaceData>;
+	using LightHierarchy = JL::LightHierarchy<DIMENTIONS, WorldValue>;
+	using Acceleration = JL::Acceleration;
+
 	struct Scene
 	{
 		ObjectContainer objects;
 		LightsourceContainer lights;
+		ObjectHierarchy hierarchy{};
+		LightHierarchy lightHierarchy{}; // point lights and directional lights in container order, see RenderSettings::lightSamples
+		Acceleration acceleration{ Acceleration::bvh }; // what BuildHierarchy puts the objects in
+
+		// Call after adding, moving or transforming objects or lights (and after copying the scene)
+		void BuildHierarchy();
+	};
+
+	// Order tiles are handed to the threads in, and pixel blocks are traced in within a tile.
+	// Along a space filling curve, consecutive packets stay close on screen and mostly visit the same hierarchy nodes
+	enum class PixelOrder
+	{
+		scanline, // row by row
+		morton,   // Z order curve
+		hilbert,  // Hilbert curve
 	};
 
 	struct RenderSettings
@@ -76,6 +105,10 @@ namespace Elite
 		bool PBR;
 		bool hardShadows;
 		bool maxToAll;
+		bool progressive; // accumulate samples over frames, see Renderer::TraceProgressive
+		PixelOrder order;
+		ColourValue lightCutoff; // point lights only reach as far as their intensity stays above it, 0 for no limit. See Renderer::BuildLightLists
+		size_t lightSamples;     // lights picked per hit from the scene's light hierarchy, 0 to shade every light
 	};
 
 	NDCPoint   & RasterToNCD    (NDCPoint   & result, const RasterPoint value, const RasterValue width, const RasterValue height);
@@ -87,9 +120,6 @@ namespace Elite
 	RasterPoint  ScreenToRaster                      (const ScreenPoint value, const RasterValue width, const RasterValue height);
 
 
-	WorldVector GetNormal(ObjectContainer::PtrVariant const& object, WorldPoint const& hitPoint, Intersection const& intersectionResult, WorldVector const& view);
-	
-
-	SurfaceData const& GetSurfaceData(ObjectContainer::PtrVariant const& object);
+	WorldVector GetNormal(ObjectHierarchy const& objects, ObjectHierarchy::Primitive const& primitive, WorldPoint const& hitPoint, Intersection const& intersectionResult, WorldVector const& view);
 
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 //External includes
+#ifdef _MSC_VER
 #include <vld.h>
+#endif
 #include "SDL.h"
 #include "SDL_surface.h"
 #undef main
@@ -8,11 +10,23 @@
 #include <iostream>
 #include <string_view>
 #include <string>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <numeric>
+#include <limits>
+#include <charconv>
+#include <system_error>
+#include <cmath>
 
 //Project includes
 #include "ETimer.h"
 #include "ERenderer.h"
 #include "RenderUtils.h"
+#include "ImageUtils.h"
+#include "Benchmark.h"
 
 #include "CameraMovement.h"
 
@@ -24,11 +38,33 @@ void ShutDown(SDL_Window* pWindow)
 
 using Scenes = std::vector<Elite::Scene>;
 
+// Indexed by Elite::PixelOrder
+constexpr std::string_view PIXEL_ORDER_NAMES[]{ "scanline", "morton", "hilbert" };
+// Indexed by Elite::Acceleration
+constexpr std::string_view ACCELERATION_NAMES[]{ "bvh", "grid" };
+
 Scenes GenerateScenes();
+Scenes LoadScenes(bool lazyMeshes = false);
+std::vector<Elite::Sphere> MakeCloud(size_t count, float minRadius, float maxRadius);
+Elite::SphereSet MakeParticles(size_t count);
+Elite::ObjectContainer MakeSwarm(size_t count);
+
+int RenderHeadless(int argc, char const* argv[]);
+template<typename Number>
+bool ParseNumber(Number& result, std::string_view text);
+int RunBenchmark(int argc, char const* argv[]);
 
-int main(int const, char const* [])
+int main(int argc, char const* argv[])
 {
 
+	for (int i{ 1 }; i < argc; ++i)
+	{
+		if (std::string_view{ argv[i] } == "--headless")
+			return RenderHeadless(argc, argv);
+		if (std::string_view{ argv[i] } == "--benchmark")
+			return RunBenchmark(argc, argv);
+	}
+
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
 
@@ -58,19 +94,23 @@ int main(int const, char const* [])
 	renderSettings.PBR = true;
 	renderSettings.maxToAll = false;
 	renderSettings.hardShadows = true;
+	renderSettings.progressive = true;
+	renderSettings.order = Elite::PixelOrder::hilbert;
+	renderSettings.lightCutoff = 1.f / 256.f; // a step of an 8 bit channel
+	renderSettings.lightSamples = 0;
 
-	auto scenes{ GenerateScenes() };
+	auto scenes{ LoadScenes() };
 	size_t sceneIndex{ 0 };
 
-	Elite::Mesh bunny{};
-	JL::LoadMesh(bunny, R"(lowpoly_bunny.obj)");
-	scenes[2].objects += Elite::WorldObject<Elite::Mesh>{ std::move(bunny), { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { Elite::CullMode::front } };
+	for (auto& scene : scenes)
+		scene.BuildHierarchy();
 
 	//Start loop
 	pTimer->Start();
 	float printTimer = 0.f;
 	bool isLooping = true;
 	bool takeScreenshot = false;
+	bool animate = true;
 
 	//Elite::Camera::Vector cameraForward{};
 	//constexpr bool invertControls{ true };
@@ -117,6 +157,32 @@ int main(int const, char const* [])
 					++sceneIndex;
 					sceneIndex %= scenes.size();
 					break;
+
+				case SDL_SCANCODE_N:
+					renderSettings.progressive ^= true;
+					break;
+
+				case SDL_SCANCODE_M:
+					animate ^= true;
+					break;
+
+				case SDL_SCANCODE_J:
+					renderSettings.order = Elite::PixelOrder((int(renderSettings.order) + 1) % 3);
+					std::cout << "Pixel order: " << PIXEL_ORDER_NAMES[int(renderSettings.order)] << std::endl;
+					break;
+
+				case SDL_SCANCODE_U:
+					renderSettings.lightSamples = renderSettings.lightSamples == 0 ? 1 : 0; // noisy per frame, progressive rendering averages it out
+					break;
+
+				case SDL_SCANCODE_G:
+				{
+					Elite::Scene& scene{ scenes[sceneIndex] };
+					scene.acceleration = Elite::Acceleration((int(scene.acceleration) + 1) % 2);
+					scene.BuildHierarchy();
+					std::cout << "Acceleration: " << ACCELERATION_NAMES[int(scene.acceleration)] << std::endl;
+					break;
+				}
 				
 				case SDL_SCANCODE_I:
 					puts(
@@ -149,6 +215,11 @@ v-( Controls )
 |   P      Toggle shadows
 |   K      Toggle render mode
 |   L      Toggle pixel adjustment
+|   N      Toggle progressive rendering
+|   M      Toggle mesh animation
+|   J      Switch pixel order
+|   U      Toggle light sampling
+|   G      Switch acceleration structure
 |
 ^
 
@@ -170,18 +241,28 @@ v-( Controls )
 			}
 		}
 
-		CameraMovement::Update(camera, pTimer->GetElapsed(), mouseDeltaX, -mouseDeltaY, mouseWheelDelta);
+		const bool moved{ CameraMovement::Update(camera, pTimer->GetElapsed(), mouseDeltaX, -mouseDeltaY, mouseWheelDelta) }; // camera motion restarts with the coarse previews
 
 		//Update scene, will be moved when a better place is available.
+		if (animate)
 		{
 			auto y{ Elite::MakeRotationY(float(M_PI) / 4.f * pTimer->GetElapsed()) };
-			for (auto& mesh : scenes[sceneIndex].objects.Get<Elite::WorldObject<Elite::Mesh>>())
+			for (auto& instance : scenes[sceneIndex].objects.Get<Elite::WorldObject<Elite::MeshInstance>>())
 			{
-				mesh.Transform(y);
+				// only the screen regions the mesh was and is visible or casting shadows in are traced again
+				Elite::Box bounds{};
+				if (JL::GetBounds(bounds, instance))
+					pRenderer->Invalidate(bounds);
+				instance.Transform(y); // the shared geometry and its hierarchy stay as they are
+				if (JL::GetBounds(bounds, instance))
+					pRenderer->Invalidate(bounds);
 			}
+			scenes[sceneIndex].BuildHierarchy();
 		}
 
 		//--------- Render ---------
+		if (moved)
+			pRenderer->Restart();
 		pRenderer->Render(camera, scenes[sceneIndex], renderSettings);
 
 		//--------- Timer ---------
@@ -214,12 +295,353 @@ v-( Controls )
 }
 
 
+// Renders a single frame without a window and writes it to a file.
+// Every phase is timed, timings go to stdout.
+int RenderHeadless(int argc, char const* argv[])
+{
+	using Clock = std::chrono::steady_clock;
+	auto const milliseconds = [](Clock::time_point const& start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	};
+
+	// Options
+
+	size_t sceneIndex{ 0 };
+	Elite::RasterValue width{ 640 };
+	Elite::RasterValue height{ 480 };
+	Elite::WorldPoint position{ 0.f, 1.f, -4.f };
+	Elite::WorldVector direction{ 0.f, 0.f, 1.f };
+	float fieldOfView{ 90.f };
+	std::string output{ "render.png" };
+
+	Elite::RenderSettings renderSettings{};
+	renderSettings.PBR = true;
+	renderSettings.maxToAll = false;
+	renderSettings.hardShadows = true;
+	renderSettings.progressive = false;
+	renderSettings.order = Elite::PixelOrder::hilbert;
+	renderSettings.lightCutoff = 0; // exact
+	renderSettings.lightSamples = 0;
+	size_t samples{ 1 };
+	bool traversalStats{ false };
+	Elite::Acceleration acceleration{ Elite::Acceleration::bvh };
+	bool compareAcceleration{ false };
+	bool lazyMeshes{ false };
+
+	bool valid{ true };
+	for (int i{ 1 }; i < argc && valid; ++i)
+	{
+		const std::string_view option{ argv[i] };
+		auto const has = [argc, i](int count) { return i + count < argc; };
+		auto const number = [argv, &i, &valid](auto& result) { valid &= ParseNumber(result, argv[++i]); };
+
+		if (option == "--headless")
+			continue;
+		else if (option == "--scene" && has(1))
+			number(sceneIndex);
+		else if (option == "--size" && has(2))
+		{
+			number(width);
+			number(height);
+		}
+		else if (option == "--position" && has(3))
+		{
+			number(position.x);
+			number(position.y);
+			number(position.z);
+		}
+		else if (option == "--direction" && has(3))
+		{
+			number(direction.x);
+			number(direction.y);
+			number(direction.z);
+		}
+		else if (option == "--fov" && has(1))
+			number(fieldOfView);
+		else if (option == "--output" && has(1))
+			output = argv[++i];
+		else if (option == "--lmbr")
+			renderSettings.PBR = false;
+		else if (option == "--no-shadows")
+			renderSettings.hardShadows = false;
+		else if (option == "--max-to-all")
+			renderSettings.maxToAll = true;
+		else if (option == "--samples" && has(1))
+			number(samples);
+		else if (option == "--order" && has(1))
+		{
+			auto const name{ std::find(std::begin(PIXEL_ORDER_NAMES), std::end(PIXEL_ORDER_NAMES), std::string_view{ argv[++i] }) };
+			renderSettings.order = Elite::PixelOrder(name - std::begin(PIXEL_ORDER_NAMES));
+			valid = name != std::end(PIXEL_ORDER_NAMES);
+		}
+		else if (option == "--traversal-stats")
+			traversalStats = true;
+		else if (option == "--acceleration" && has(1))
+		{
+			auto const name{ std::find(std::begin(ACCELERATION_NAMES), std::end(ACCELERATION_NAMES), std::string_view{ argv[++i] }) };
+			acceleration = Elite::Acceleration(name - std::begin(ACCELERATION_NAMES));
+			valid = name != std::end(ACCELERATION_NAMES);
+		}
+		else if (option == "--compare-acceleration")
+			compareAcceleration = true;
+		else if (option == "--lazy-meshes")
+			lazyMeshes = true;
+		else if (option == "--light-cutoff" && has(1))
+			number(renderSettings.lightCutoff);
+		else if (option == "--light-samples" && has(1))
+			number(renderSettings.lightSamples);
+		else
+			valid = false;
+	}
+
+	constexpr Elite::RasterValue maxSize{ 1 << 15 };
+	valid &= width != 0 && height != 0 && width <= maxSize && height <= maxSize;
+	valid &= samples != 0 && fieldOfView > 0.f && fieldOfView < 180.f && renderSettings.lightCutoff >= 0.f;
+	valid &= Elite::SqrMagnitude(direction) > 0.f;
+	if (!valid)
+	{
+		puts(
+R"(Usage: RayTracer --headless [options]
+
+  --scene <index>          scene to render (0)
+  --size <width> <height>  resolution (640 480)
+  --position <x> <y> <z>   camera position (0 1 -4)
+  --direction <x> <y> <z>  camera direction (0 0 1)
+  --fov <degrees>          field of view (90)
+  --output <file>          .png, .ppm or .pfm (render.png). pfm holds the unscaled colours
+  --lmbr                   LMBR shading instead of PBR
+  --no-shadows             disable hard shadows
+  --max-to-all             scale the frame by its brightest value
+  --samples <count>        jittered samples per pixel, averaged (1)
+  --order <order>          scanline, morton or hilbert: tile and pixel block order (hilbert)
+  --traversal-stats        trace once more in every order, counting hierarchy nodes visited
+  --acceleration <name>    bvh or grid: structure the objects are traced through (bvh)
+  --compare-acceleration   rebuild and trace once more with every structure, timing both
+  --lazy-meshes            meshes without an up to date cache are split while tracing instead of when loaded
+  --light-cutoff <value>   point lights only light where their intensity is above it (0: everywhere)
+  --light-samples <count>  lights picked per hit by importance instead of shading every light (0: every light)
+)"
+		);
+		return 1;
+	}
+
+	// Phases
+
+	Clock::time_point start{ Clock::now() };
+	auto scenes{ LoadScenes(lazyMeshes) };
+	std::cout << "load scenes:     " << milliseconds(start) << " ms" << std::endl;
+
+	if (sceneIndex >= scenes.size())
+	{
+		std::cout << "There is no scene " << sceneIndex << ", there are " << scenes.size() << std::endl;
+		return 1;
+	}
+	Elite::Scene& scene{ scenes[sceneIndex] };
+
+	start = Clock::now();
+	scene.acceleration = acceleration;
+	scene.BuildHierarchy();
+	std::cout << "build hierarchy: " << milliseconds(start) << " ms" << std::endl;
+
+	Elite::Camera camera{};
+	camera.SetScreenAspectRatio(static_cast<float>(width), static_cast<float>(height));
+	camera.SetPosition(position);
+	camera.SetDirection(direction);
+	camera.SetFieldOfView(fieldOfView * float(E_TO_RADIANS));
+
+	start = Clock::now();
+	Elite::Renderer renderer{ width, height };
+	std::cout << "setup renderer:  " << milliseconds(start) << " ms" << std::endl;
+
+	start = Clock::now();
+	Elite::ColourValue high{};
+	if (samples == 1)
+		high = renderer.Trace(camera, scene, renderSettings);
+	else
+	{
+		renderer.Restart(false);
+		while (renderer.GetSampleCount() < samples)
+			high = renderer.TraceProgressive(camera, scene, renderSettings);
+	}
+	std::cout << "trace:           " << milliseconds(start) << " ms (" << width << 'x' << height << ", " << samples << " spp)" << std::endl;
+
+	start = Clock::now();
+	const bool written{ Elite::WriteImage(output, renderer.GetFramebuffer(), width, height, 255.f / (renderSettings.maxToAll ? high : 1)) };
+	std::cout << "write image:     " << milliseconds(start) << " ms" << std::endl;
+
+	if (!written)
+	{
+		std::cout << "Could not write " << output << std::endl;
+		return 1;
+	}
+	std::cout << "Saved " << output << std::endl;
+
+	// Nodes visited per ray do not depend on the order, cache misses do
+	if (traversalStats)
+	{
+		renderer.SetTraversalCounting(true);
+		for (size_t order{}; order < std::size(PIXEL_ORDER_NAMES); ++order)
+		{
+			renderSettings.order = Elite::PixelOrder(order);
+			renderer.Restart(false);
+			start = Clock::now();
+			renderer.Trace(camera, scene, renderSettings);
+			const double time{ milliseconds(start) };
+
+			const Elite::Renderer::TraversalStats stats{ renderer.GetTraversalStats() };
+			const double rays{ double(std::max<size_t>(stats.rays, 1)) };
+			std::cout
+				<< "traversal " << PIXEL_ORDER_NAMES[order] << ": " << stats.visits / rays << " nodes, "
+				<< stats.misses / rays << " misses per ray, " << time << " ms" << std::endl;
+		}
+		renderer.SetTraversalCounting(false);
+	}
+
+	// What a frame of a scene whose objects all moved costs with either structure: a full rebuild and a trace.
+	// Every frame moves each sphere object to its own offset for that frame, scene 4 is a swarm of them.
+	// Best of a few frames, and the pixels that differ from the first structure's last frame, the same for both
+	if (compareAcceleration)
+	{
+		constexpr int FRAMES{ 5 };
+		auto& spheres{ scene.objects.Get<Elite::WorldObject<Elite::Sphere>>() };
+		std::vector<Elite::WorldPoint> rest{};
+		for (Elite::Sphere const& sphere : spheres)
+			rest.push_back(sphere.center);
+
+		std::vector<Elite::Colour> reference{};
+		for (size_t structure{}; structure < std::size(ACCELERATION_NAMES); ++structure)
+		{
+			scene.acceleration = Elite::Acceleration(structure);
+			double build{ std::numeric_limits<double>::max() };
+			double trace{ std::numeric_limits<double>::max() };
+			for (int frame{}; frame < FRAMES; ++frame)
+			{
+				for (size_t i{}; i < spheres.size(); ++i)
+					spheres[i].center = rest[i] + Elite::WorldVector{ 0.f, .1f * std::sin(float(frame + 1) + float(i)), 0.f };
+
+				start = Clock::now();
+				scene.BuildHierarchy();
+				build = std::min(build, milliseconds(start));
+
+				renderer.Restart(false);
+				start = Clock::now();
+				renderer.Trace(camera, scene, renderSettings);
+				trace = std::min(trace, milliseconds(start));
+			}
+
+			std::vector<Elite::Colour> const& frame{ renderer.GetFramebuffer() };
+			if (reference.empty())
+				reference = frame;
+			const size_t different{ size_t(std::inner_product(
+				frame.begin(), frame.end(), reference.begin(), ptrdiff_t{}, std::plus<>{},
+				[](Elite::Colour const& a, Elite::Colour const& b) { return a.r != b.r || a.g != b.g || a.b != b.b; }
+			)) };
+			std::cout
+				<< "acceleration " << ACCELERATION_NAMES[structure] << ": build " << build << " ms, trace " << trace << " ms, "
+				<< build + trace << " ms per frame, " << different << " pixels differ" << std::endl;
+		}
+	}
+	return 0;
+}
+
+// Times the intersection, shading and camera kernels in isolation, writes csv
+int RunBenchmark(int argc, char const* argv[])
+{
+	Elite::BenchmarkSettings settings{};
+	std::string output{};
+
+	bool valid{ true };
+	for (int i{ 1 }; i < argc && valid; ++i)
+	{
+		const std::string_view option{ argv[i] };
+		auto const has = [argc, i](int count) { return i + count < argc; };
+		auto const number = [argv, &i, &valid](auto& result) { valid &= ParseNumber(result, argv[++i]); };
+
+		if (option == "--benchmark")
+			continue;
+		else if (option == "--seed" && has(1))
+			number(settings.seed);
+		else if (option == "--rays" && has(1))
+			number(settings.rayCount);
+		else if (option == "--primitives" && has(1))
+			number(settings.primitiveCount);
+		else if (option == "--time" && has(1))
+			number(settings.minimumSeconds);
+		else if (option == "--output" && has(1))
+			output = argv[++i];
+		else
+			valid = false;
+	}
+
+	if (!valid || settings.rayCount == 0 || settings.primitiveCount == 0 || settings.minimumSeconds < 0.)
+	{
+		puts(
+R"(Usage: RayTracer --benchmark [options]
+
+  --seed <seed>            seed of the ray sets and primitives (2020)
+  --rays <count>           rays per ray set (16384)
+  --primitives <count>     primitives per intersection kernel (64)
+  --time <seconds>         minimum run time per kernel (0.2)
+  --output <file>          csv file to write, stdout when omitted
+)"
+		);
+		return 1;
+	}
+
+	if (output.empty())
+	{
+		Elite::RunBenchmarks(std::cout, settings);
+		return 0;
+	}
+
+	std::ofstream file{ output };
+	if (!file)
+	{
+		std::cout << "Could not write " << output << std::endl;
+		return 1;
+	}
+	Elite::RunBenchmarks(file, settings);
+	return 0;
+}
+
+// The whole of text as a number of that type: false for anything else, for values out of its range and for infinities.
+// Integers are unsigned here, from_chars takes no minus sign for those
+template<typename Number>
+bool ParseNumber(Number& result, std::string_view text)
+{
+	Number value{};
+	auto const [end, error] { std::from_chars(text.data(), text.data() + text.size(), value) };
+	if (text.empty() || error != std::errc{} || end != text.data() + text.size())
+		return false;
+	if constexpr (std::is_floating_point_v<Number>)
+	{
+		if (!std::isfinite(value))
+			return false;
+	}
+	result = value;
+	return true;
+}
+
+// All scenes, hierarchies are not built yet. lazyMeshes: see JL::LoadMesh
+Scenes LoadScenes(bool lazyMeshes)
+{
+	auto scenes{ GenerateScenes() };
+
+	auto pBunny{ std::make_shared<Elite::Mesh>() };
+	JL::LoadMesh(*pBunny, R"(lowpoly_bunny.obj)", lazyMeshes);
+	scenes[2].objects += Elite::WorldObject<Elite::MeshInstance>{ Elite::MeshInstance{ pBunny }, { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { Elite::CullMode::front } };
+
+	return scenes;
+}
+
 Scenes GenerateScenes()
 {
 	using namespace Elite;
 
-	Mesh triangle{};
-	JL::LoadMesh(triangle, R"(triangle.obj)");
+	// one triangle mesh, shared by every copy in the scenes
+	auto pTriangle{ std::make_shared<Mesh>() };
+	JL::LoadMesh(*pTriangle, R"(triangle.obj)");
 
 	return {
 
@@ -241,9 +663,9 @@ Scenes GenerateScenes()
 				WorldObject<Sphere>{ { {  0, 2.5, 0 }, 1.f / sqrtf(2) }, { { .5f, 1.f, .8f }, 1.f, 1, .6f, false }, {} },
 				WorldObject<Sphere>{ { {  2, 2.5, 0 }, 1.f / sqrtf(2) }, { { .5f, 1.f, .8f }, 1.f, 1, 1.f, false }, {} },
 
-				WorldObject<Mesh>{ (triangle.Translate({ -2, 4, 0 }), triangle), { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { CullMode::front } },
-				WorldObject<Mesh>{ (triangle.Translate({  2, 0, 0 }), triangle), { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { CullMode::both  } },
-				WorldObject<Mesh>{ (triangle.Translate({  2, 0, 0 }), triangle), { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { CullMode::back  } }
+				WorldObject<MeshInstance>{ MeshInstance{ pTriangle, { -2, 4, 0 } }, { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { CullMode::front } },
+				WorldObject<MeshInstance>{ MeshInstance{ pTriangle, {  0, 4, 0 } }, { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { CullMode::both  } },
+				WorldObject<MeshInstance>{ MeshInstance{ pTriangle, {  2, 4, 0 } }, { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { CullMode::back  } }
 
 			},
 			LightsourceContainer{
@@ -268,9 +690,9 @@ Scenes GenerateScenes()
 				WorldObject<Sphere>{ { {  0, 2.5, 0 }, 1.f / sqrtf(2) }, { { .5f, 1.f, .8f }, 1.f, 1, .6f, false }, {} },
 				WorldObject<Sphere>{ { {  2, 2.5, 0 }, 1.f / sqrtf(2) }, { { .5f, 1.f, .8f }, 1.f, 1, 1.f, false }, {} },
 
-				WorldObject<Mesh>{ (triangle.Translate({ -4, 0, 0 }), triangle), { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { CullMode::front } },
-				WorldObject<Mesh>{ (triangle.Translate({  2, 0, 0 }), triangle), { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { CullMode::both  } },
-				WorldObject<Mesh>{ (triangle.Translate({  2, 0, 0 }), triangle), { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { CullMode::back  } }
+				WorldObject<MeshInstance>{ MeshInstance{ pTriangle, { -2, 4, 0 } }, { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { CullMode::front } },
+				WorldObject<MeshInstance>{ MeshInstance{ pTriangle, {  0, 4, 0 } }, { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { CullMode::both  } },
+				WorldObject<MeshInstance>{ MeshInstance{ pTriangle, {  2, 4, 0 } }, { { 1.f, .8f, .5f }, 1.f, 1, .6f, true }, { CullMode::back  } }
 
 			},
 			LightsourceContainer{
@@ -297,8 +719,72 @@ Scenes GenerateScenes()
 				WorldObject<PointLight>{ { { 1, 6, -1.f  }, 10 }, { { .8f, .8f, 1.f } }, {} },
 				WorldObject<DirectionalLight>{ { { -.5f, -1.f, -.5f }, 1.f }, { { 1.f, 1.f, 1.f } }, {} }
 
+			}
+		},
+
+		Scene{
+			ObjectContainer{
+
+				WorldObject<Plane>    { { { 0, -2, 0 }, { 0,  1, 0 } }, { { 1.f, 1.f, 1.f }, 1 }, {} },
+				WorldObject<SphereSet>{ MakeParticles(50000), { { .5f, .8f, 1.f }, 1.f, 1, .4f, true }, {} }
+
+			},
+			LightsourceContainer{
+
+				WorldObject<PointLight>{ { { -3, 6, 0.f  }, 25 }, { { 1.f, 1.f, .8f } }, {} },
+				WorldObject<PointLight>{ { { 3, 2, -1.f  }, 15 }, { { .8f, .8f, 1.f } }, {} },
+				WorldObject<DirectionalLight>{ { { -.5f, -1.f, .5f }, 1.f }, { { 1.f, 1.f, 1.f } }, {} }
+
+			}
+		},
+
+		Scene{
+			MakeSwarm(20000),
+			LightsourceContainer{
+
+				WorldObject<PointLight>{ { { -3, 6, 0.f  }, 25 }, { { 1.f, 1.f, .8f } }, {} },
+				WorldObject<PointLight>{ { { 3, 2, -1.f  }, 15 }, { { .8f, .8f, 1.f } }, {} },
+				WorldObject<DirectionalLight>{ { { -.5f, -1.f, .5f }, 1.f }, { { 1.f, 1.f, 1.f } }, {} }
+
 			}
 		}
 
 	};
-}
\ No newline at end of file
+}
+
+// Spheres spread through a ball in front of the default camera, the same for every run and compiler
+std::vector<Elite::Sphere> MakeCloud(size_t count, float minRadius, float maxRadius)
+{
+	std::mt19937 engine{ 2020 };
+	auto const next = [&engine](float low, float high)
+	{
+		return low + (high - low) * static_cast<float>(engine() >> 8) * (1.f / 16777216.f);
+	};
+
+	std::vector<Elite::Sphere> spheres{};
+	spheres.reserve(count);
+	while (spheres.size() < count)
+	{
+		const Elite::WorldVector offset{ next(-1.f, 1.f), next(-1.f, 1.f), next(-1.f, 1.f) };
+		if (Elite::SqrMagnitude(offset) <= 1.f)
+			spheres.push_back(Elite::Sphere{ Elite::WorldPoint{ 0.f, 1.f, 3.f } + offset * 2.f, next(minRadius, maxRadius) });
+	}
+	return spheres;
+}
+
+// A cloud of small spheres as a single object
+Elite::SphereSet MakeParticles(size_t count)
+{
+	return Elite::SphereSet{ MakeCloud(count, .02f, .05f) };
+}
+
+// A floor and a cloud of spheres that are objects of their own, each free to move
+Elite::ObjectContainer MakeSwarm(size_t count)
+{
+	Elite::ObjectContainer objects{
+		Elite::WorldObject<Elite::Plane>{ { { 0, -2, 0 }, { 0, 1, 0 } }, { { 1.f, 1.f, 1.f }, 1 }, {} }
+	};
+	for (Elite::Sphere const& sphere : MakeCloud(count, .02f, .05f))
+		objects += Elite::WorldObject<Elite::Sphere>{ sphere, { { 1.f, .6f, .3f }, 1.f, 1, .4f, true }, {} };
+	return objects;
+}